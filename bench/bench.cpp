@@ -0,0 +1,331 @@
+#include "spark_json.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+using namespace SparkJson;
+
+// 替换全局 operator new 以统计分配次数
+static size_t alloc_count = 0;
+
+void* operator new(size_t size){
+    alloc_count++;
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    alloc_count++;
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+
+// std::pmr 的默认 memory_resource 使用带对齐参数的版本
+void* operator new(size_t size, std::align_val_t align){
+    alloc_count++;
+    size_t alignment = static_cast<size_t>(align);
+    void* p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start){
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static double mb_per_second(size_t bytes, double seconds){
+    return bytes / seconds / (1024 * 1024);
+}
+
+// 进程的峰值常驻内存 (MB), 不支持时返回 0
+static double peak_rss_mb(){
+#ifndef _WIN32
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+    }
+#endif
+    return 0;
+}
+
+// 固定种子的 xorshift, 各平台生成的语料完全相同
+class Random{
+  public:
+    explicit Random(uint64_t seed) : _state(seed){}
+
+    uint64_t next(){
+        _state ^= _state << 13;
+        _state ^= _state >> 7;
+        _state ^= _state << 17;
+        return _state;
+    }
+    size_t below(size_t n) { return next() % n; }
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    std::string word(size_t minLen, size_t maxLen){
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+        std::string out(minLen + below(maxLen - minLen + 1), ' ');
+        for(char& ch : out)
+            ch = letters[below(26)];
+        return out;
+    }
+
+  private:
+    uint64_t _state;
+};
+
+// twitter 风格: 字符串为主, 大整数 id, 嵌套的 user/entities 对象, 含转义和非 ASCII 字符
+static std::string make_twitter_corpus(size_t statuses){
+    Random rnd(1);
+    Json::array list;
+    for(size_t i = 0; i < statuses; i++){
+        std::string text;
+        for(size_t w = 0; w < 12; w++)
+            text += rnd.word(2, 9) + (w % 5 == 4 ? " \xe6\x97\xa5\xe6\x9c\xac \"q\"\n" : " ");
+        Json::array hashtags;
+        for(size_t h = rnd.below(3); h > 0; h--)
+            hashtags.push_back(Json::object{ { "text", rnd.word(4, 10) }, { "indices", Json::array{ 10, 20 } } });
+        Json::object user{
+            { "id", static_cast<uint64_t>(rnd.next() >> 8) },
+            { "screen_name", rnd.word(5, 12) },
+            { "name", rnd.word(3, 8) + " " + rnd.word(3, 10) },
+            { "description", rnd.word(20, 60) },
+            { "followers_count", static_cast<int>(rnd.below(100000)) },
+            { "verified", rnd.below(10) == 0 },
+            { "profile_image_url", "https://img.example.com/" + rnd.word(16, 16) + ".png" },
+            { "url", nullptr }
+        };
+        list.push_back(Json::object{
+            { "id", static_cast<uint64_t>(rnd.next() >> 1) },
+            { "id_str", std::to_string(rnd.next() >> 1) },
+            { "created_at", "Mon Sep 24 03:35:21 +0000 2012" },
+            { "text", text },
+            { "user", user },
+            { "entities", Json::object{ { "hashtags", hashtags }, { "urls", Json::array{} } } },
+            { "retweet_count", static_cast<int>(rnd.below(1000)) },
+            { "favorited", false },
+            { "in_reply_to_status_id", nullptr },
+            { "lang", "ja" }
+        });
+    }
+    return Json(Json::object{ { "statuses", list } }).dump();
+}
+
+// canada 风格: 深层数组中的大量高精度浮点坐标
+static std::string make_canada_corpus(size_t rings){
+    Random rnd(2);
+    Json::array polygons;
+    for(size_t r = 0; r < rings; r++){
+        Json::array ring;
+        for(size_t p = 0; p < 200; p++)
+            ring.push_back(Json::array{ -140.0 + rnd.unit() * 90.0, 42.0 + rnd.unit() * 40.0 });
+        polygons.push_back(Json::array{ ring });
+    }
+    Json::object geometry{ { "type", "MultiPolygon" }, { "coordinates", polygons } };
+    Json::object feature{ { "type", "Feature" }, { "properties", Json::object{ { "name", "Canada" } } }, { "geometry", geometry } };
+    return Json(Json::object{ { "type", "FeatureCollection" }, { "features", Json::array{ feature } } }).dump();
+}
+
+// citm 风格: 以数字字符串为键的大对象, 整数数组, 大量 null 和重复的小对象
+static std::string make_citm_corpus(size_t events){
+    Random rnd(3);
+    Json::object names;
+    Json::object eventMap;
+    Json::array performances;
+    for(size_t i = 0; i < events; i++){
+        std::string id = std::to_string(138586341 + i * 7);
+        names[id] = rnd.word(6, 30);
+        Json::array topics;
+        for(size_t t = 0; t < 4; t++)
+            topics.push_back(static_cast<int>(324846099 + rnd.below(200)));
+        eventMap[id] = Json::object{
+            { "description", nullptr },
+            { "id", static_cast<int64_t>(138586341 + i * 7) },
+            { "logo", rnd.below(2) ? Json("/images/UE0AAAAACEKo6QAAAAZDSVRN") : Json(nullptr) },
+            { "name", rnd.word(8, 40) },
+            { "subTopicIds", topics },
+            { "subjectCode", nullptr },
+            { "subtitle", nullptr },
+            { "topicIds", Json::array{ 324846099, 107888604 } }
+        };
+        Json::array prices;
+        for(size_t p = 0; p < 6; p++)
+            prices.push_back(Json::object{ { "amount", static_cast<int>(rnd.below(100000)) },
+                                           { "audienceSubCategoryId", 337100890 },
+                                           { "seatCategoryId", static_cast<int>(338937295 + p) } });
+        performances.push_back(Json::object{
+            { "eventId", static_cast<int64_t>(138586341 + i * 7) },
+            { "id", static_cast<int64_t>(339887544 + i) },
+            { "logo", nullptr },
+            { "name", nullptr },
+            { "prices", prices },
+            { "start", static_cast<int64_t>(1372701600000LL + i * 86400000LL) },
+            { "venueCode", "PLEYEL_PLEYEL" }
+        });
+    }
+    return Json(Json::object{ { "areaNames", names }, { "events", eventMap }, { "performances", performances } }).dump();
+}
+
+// 解析和输出的吞吐量, 以及每个文档的分配次数
+static void bench_corpus(const char* name, const std::string& corpus, int rounds){
+    size_t parseAllocs = 0;
+    Json json;
+    bench_clock::time_point start = bench_clock::now();
+    for(int i = 0; i < rounds; i++){
+        size_t before = alloc_count;
+        json = Json::parse(corpus);
+        parseAllocs += alloc_count - before;
+    }
+    double parseTime = seconds_since(start);
+    if(json.getErrorCode() != PARSE_OK){
+        printf("%s: parse error %d\n", name, json.getErrorCode());
+        return;
+    }
+
+    size_t dumpAllocs = 0;
+    size_t dumped = 0;
+    start = bench_clock::now();
+    for(int i = 0; i < rounds; i++){
+        size_t before = alloc_count;
+        std::string out;
+        json.dump(out);
+        dumpAllocs += alloc_count - before;
+        dumped += out.size();
+    }
+    double dumpTime = seconds_since(start);
+
+    printf("%-9s %6.2f MB  parse %8.1f MB/s %10.1f allocs/doc  dump %8.1f MB/s %8.1f allocs/doc\n",
+           name, corpus.size() / (1024.0 * 1024), mb_per_second(corpus.size() * rounds, parseTime),
+           parseAllocs / (double)rounds, mb_per_second(dumped, dumpTime), dumpAllocs / (double)rounds);
+}
+
+// MessagePack 编码和解码的吞吐量, 以编码后的字节数计算
+static void bench_msgpack(const char* name, const std::string& corpus, int rounds){
+    Json json = Json::parse(corpus);
+    std::string packed;
+    bench_clock::time_point start = bench_clock::now();
+    for(int i = 0; i < rounds; i++){
+        packed.clear();
+        json.dump_msgpack(packed);
+    }
+    double dumpTime = seconds_since(start);
+
+    start = bench_clock::now();
+    for(int i = 0; i < rounds; i++)
+        json = Json::parse_msgpack(packed);
+    double parseTime = seconds_since(start);
+    if(json.getErrorCode() != PARSE_OK){
+        printf("%s: msgpack error %d\n", name, json.getErrorCode());
+        return;
+    }
+
+    printf("%-9s %6.2f MB  msgpack parse %8.1f MB/s  dump %8.1f MB/s\n", name, packed.size() / (1024.0 * 1024),
+           mb_per_second(packed.size() * rounds, parseTime), mb_per_second(packed.size() * rounds, dumpTime));
+}
+
+// 从 tape 缓存中读取: 打开视图并访问每条 status 的一个字段, 与完整解析对比
+static void bench_tape(const std::string& corpus){
+    std::string tape;
+    Json::parse(corpus).dump_tape(tape);
+    const int rounds = 200;
+    size_t sum = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(int r = 0; r < rounds; r++){
+        JsonTapeView root(tape);
+        sum += root["statuses"].size();
+    }
+    double openTime = seconds_since(start) / rounds;
+
+    JsonTapeView statuses = JsonTapeView(tape)["statuses"];
+    const size_t count = statuses.size();
+    start = bench_clock::now();
+    for(size_t i = 0; i < count; i++)
+        sum += statuses[i]["user"]["screen_name"].to_string().size();
+    double scanTime = seconds_since(start);
+
+    start = bench_clock::now();
+    Json json = Json::parse(corpus);
+    double parseTime = seconds_since(start);
+
+    printf("tape      %6.2f MB  open+lookup %8.2f us  %zu lookups %8.2f us  (parse %8.2f us, checksum %zu)\n",
+           tape.size() / (1024.0 * 1024), openTime * 1e6, count, scanTime * 1e6, parseTime * 1e6, sum);
+}
+
+// 每条 status 读取三个字段: 一次数组下标和多次对象查找
+static void bench_lookup(const std::string& corpus){
+    Json json = Json::parse(corpus);
+    const Json& root = json;
+    const Json& statuses = root["statuses"];
+    const size_t count = statuses.size();
+    const std::string user = "user", screen_name = "screen_name", followers = "followers_count", id = "id";
+    const int rounds = 200;
+    size_t sum = 0;
+    size_t before = alloc_count;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(int r = 0; r < rounds; r++){
+        for(size_t i = 0; i < count; i++){
+            const Json& status = statuses[i];
+            sum += status[user][screen_name].to_string_view().size();
+            sum += status[user][followers].to_int();
+            sum += status[id].to_uint64_t() & 1;
+        }
+    }
+    double elapsed = seconds_since(start);
+
+    printf("lookup    %8.1f M lookups/s %10.1f allocs  (checksum %zu)\n",
+           count * rounds * 5 / elapsed / 1e6, (double)(alloc_count - before), sum);
+}
+
+// 遥测类文档: 绝大多数值是 true/false/null 和空字符串/空容器
+static std::string make_literal_corpus(size_t rows){
+    std::string out = "[";
+    for(size_t i = 0; i < rows; i++){
+        if(i)
+            out += ",";
+        out += "{\"ok\":true,\"retry\":false,\"error\":null,\"note\":\"\",\"tags\":[],\"meta\":{},"
+               "\"flags\":[true,false,null,true,false,null,true,false]}";
+    }
+    out += "]";
+    return out;
+}
+
+int main(){
+    const std::string twitter = make_twitter_corpus(2000);
+    const std::string canada = make_canada_corpus(500);
+    const std::string citm = make_citm_corpus(2000);
+    const std::string literals = make_literal_corpus(10000);
+
+    bench_corpus("twitter", twitter, 20);
+    bench_corpus("canada", canada, 20);
+    bench_corpus("citm", citm, 20);
+    bench_corpus("literals", literals, 20);
+    bench_msgpack("twitter", twitter, 20);
+    bench_msgpack("canada", canada, 20);
+    bench_msgpack("citm", citm, 20);
+    bench_lookup(twitter);
+    bench_tape(twitter);
+
+    printf("peak RSS  %8.1f MB\n", peak_rss_mb());
+    return 0;
+}
@@ -1,57 +1,156 @@
 #include "spark_json.h"
 #include <assert.h>
 #include <cmath>
+#include <charconv>
+#include <cerrno>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <chrono>
+#include <limits>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
 namespace SparkJson
 {
-    struct Null{
-        bool operator==(Null&) const { return true; }
-        bool operator<(Null&) const { return false; }
+#ifdef SPARK_JSON_STATS
+    // 把作用域内的耗时累加到 *total, total 为空时不计时
+    class StatTimer{
+      public:
+        explicit StatTimer(uint64_t* total) : _total(total){
+            if(_total)
+                _start = chrono::steady_clock::now();
+        }
+        ~StatTimer(){
+            if(_total)
+                *_total += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _start).count();
+        }
+      private:
+        uint64_t* _total;
+        chrono::steady_clock::time_point _start;
     };
 
-    static void dump(Null, string& out){
-        out += "null";
+    // 两个宏都要求作用域内有 JsonStats* _stats
+#define SPARK_JSON_STAT(stmt) do{ if(_stats){ stmt; } }while(0)
+#define SPARK_JSON_TIMER(field) StatTimer statTimer_##field(_stats ? &_stats->field : nullptr)
+#else
+#define SPARK_JSON_STAT(stmt) do{}while(0)
+#define SPARK_JSON_TIMER(field) (void)_stats
+#endif
+
+    // 以下 dump 以 Out 为输出目标, Out 可以是 std::string 或 JsonSink
+
+    // to_chars 直接输出数字, 不经过格式串和 locale;
+    // 浮点数输出能够精确往返的最短表示
+    template<typename T, typename Out>
+    static void dumpNumber(T value, Out& out){
+        char buf[32];
+        to_chars_result r = to_chars(buf, buf + sizeof buf, value);
+        out.append(buf, r.ptr - buf);
     }
 
-    static void dump(double value, string& out){
+    template<typename Out>
+    static void dump(double value, Out& out){
         if(isfinite(value)){
-            char buf[32];
-            snprintf(buf, sizeof buf, "%g", value);
-            out += buf;
+            dumpNumber(value, out);
         }
         else{
             out += "null";
         }
     }
 
-    static void dump(int value, string& out){
-        char buf[32];
-        snprintf(buf, sizeof buf, "%d", value);
-        out += buf;
+    template<typename Out>
+    static void dump(int value, Out& out){
+        dumpNumber(value, out);
     }
 
-    static void dump(int64_t value, string& out){
-        char buf[64];
-        snprintf(buf, sizeof buf, "%lld", value);
-        out += buf;
+    template<typename Out>
+    static void dump(int64_t value, Out& out){
+        dumpNumber(value, out);
     }
 
-    static void dump(uint64_t value, string& out){
-        char buf[64];
-        snprintf(buf, sizeof buf, "%llu", value);
-        out += buf;
+    template<typename Out>
+    static void dump(uint64_t value, Out& out){
+        dumpNumber(value, out);
     }
 
-    static void dump(bool value, string& out){
+    template<typename Out>
+    static void dump(bool value, Out& out){
         out += value ? "true" : "false";
     }
 
-    static void dump(const string& value, string& out){
+    // 返回 [p, end) 中第一个 '"', '\\', 控制字符或 extra 的位置, 不存在则返回 end.
+    // 有 AVX2/SSE2 时一次比较 32/16 字节, 剩余部分逐字节处理
+    static const char* findSpecialChar(const char* p, const char* end, char extra){
+#if defined(__AVX2__)
+        const __m256i quote32 = _mm256_set1_epi8('"');
+        const __m256i backslash32 = _mm256_set1_epi8('\\');
+        const __m256i extra32 = _mm256_set1_epi8(extra);
+        const __m256i control32 = _mm256_set1_epi8(0x1F);
+        for(; end - p >= 32; p += 32){
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, quote32), _mm256_cmpeq_epi8(x, backslash32)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, extra32),
+                                _mm256_cmpeq_epi8(_mm256_max_epu8(x, control32), control32)));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(m));
+            if(mask)
+                return p + __builtin_ctz(mask);
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i quote16 = _mm_set1_epi8('"');
+        const __m128i backslash16 = _mm_set1_epi8('\\');
+        const __m128i extra16 = _mm_set1_epi8(extra);
+        const __m128i control16 = _mm_set1_epi8(0x1F);
+        for(; end - p >= 16; p += 16){
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(x, quote16), _mm_cmpeq_epi8(x, backslash16)),
+                _mm_or_si128(_mm_cmpeq_epi8(x, extra16),
+                             _mm_cmpeq_epi8(_mm_max_epu8(x, control16), control16)));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(m));
+            if(mask)
+                return p + __builtin_ctz(mask);
+        }
+#endif
+        for(; p < end; p++){
+            unsigned char ch = static_cast<unsigned char>(*p);
+            if(ch == '"' || ch == '\\' || ch <= 0x1F || ch == static_cast<unsigned char>(extra))
+                return p;
+        }
+        return end;
+    }
+
+    template<typename Out>
+    static void dump(string_view value, Out& out){
+        static const char hex[] = "0123456789abcdef";
+        const char* p = value.data();
+        const char* end = p + value.length();
         out += '"';
-        for (size_t i = 0; i < value.length(); i++) {
-            const char ch = value[i];
+        for(;;){
+            // 不需要转义的连续片段一次性追加
+            const char* q = findSpecialChar(p, end, '\xe2');
+            out.append(p, q - p);
+            if(q == end)
+                break;
+            const char ch = *q;
+            p = q + 1;
             if (ch == '\\') {
                 out += "\\\\";
             } else if (ch == '"') {
@@ -67,17 +166,17 @@ namespace SparkJson
             } else if (ch == '\t') {
                 out += "\\t";
             } else if (static_cast<uint8_t>(ch) <= 0x1f) {
-                char buf[8];
-                snprintf(buf, sizeof buf, "\\u%04x", ch);
-                out += buf;
-            } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                    && static_cast<uint8_t>(value[i+2]) == 0xa8) {
+                out += "\\u00";
+                out += hex[(ch >> 4) & 0xF];
+                out += hex[ch & 0xF];
+            } else if (end - q >= 3 && static_cast<uint8_t>(q[1]) == 0x80
+                    && static_cast<uint8_t>(q[2]) == 0xa8) {
                 out += "\\u2028";
-                i += 2;
-            } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                    && static_cast<uint8_t>(value[i+2]) == 0xa9) {
+                p = q + 3;
+            } else if (end - q >= 3 && static_cast<uint8_t>(q[1]) == 0x80
+                    && static_cast<uint8_t>(q[2]) == 0xa9) {
                 out += "\\u2029";
-                i += 2;
+                p = q + 3;
             } else {
                 out += ch;
             }
@@ -85,7 +184,8 @@ namespace SparkJson
         out += '"';
     }
 
-    static void dump(const Json::array& values, string& out){
+    template<typename Out>
+    static void dump(const Json::array& values, Out& out){
         bool first = true;
         out += "[";
         for (const auto &value : values) {
@@ -97,13 +197,14 @@ namespace SparkJson
         out += "]";
     }
 
-    static void dump(const Json::object& values, string& out){
+    template<typename Out>
+    static void dump(const Json::object& values, Out& out){
         bool first = true;
         out += "{";
         for (const auto &kv : values) {
             if (!first)
                 out += ", ";
-            dump(kv.first, out);
+            dump(kv.first.view(), out);
             out += ": ";
             kv.second.dump(out);
             first = false;
@@ -117,81 +218,56 @@ namespace SparkJson
         explicit Value(const T& value) : _value(value){}
         explicit Value(T&& value) : _value(move(value)){}
 
-        const size_t size() const override { return 1; }
-        const JsonType type() const override { return tag; }
+        size_t size() const override { return 1; }
+        JsonType type() const override { return tag; }
         void dump(string& out) const override { SparkJson::dump(_value, out); }
+        void dump(JsonSink& out) const override { SparkJson::dump(_value, out); }
 
-        const T _value;
-    };
-
-    class JsonNull : public Value<JSON_NULL, Null>{
-      public:
-        JsonNull() : Value({}) {}
-    };
-
-    class JsonBoolean : public Value<JSON_BOOL, bool>{
-        bool bool_value() const override { return _value; }
-      public:
-        explicit JsonBoolean(bool value) : Value(value){}
-    };
-
-    class JsonInt : public Value<JSON_NUMBER, int>{
-        int int_value() const override { return _value; }
-        double double_value() const override { return _value; }
-      public:
-        explicit JsonInt(int value) : Value(value){}
-    };
-
-    class JsonInt64_t : public Value<JSON_NUMBER, int64_t>{
-        int int_value() const override { return _value; }
-        double double_value() const override { return _value; }
-      public:
-        explicit JsonInt64_t(int64_t value) : Value(value){}
+        T _value;
     };
 
-    class JsonUInt64_t : public Value<JSON_NUMBER, uint64_t>{
-        int int_value() const override { return _value; }
-        double double_value() const override { return _value; }
-      public:
-        explicit JsonUInt64_t(uint64_t value) : Value(value){}
-    }; 
-
-    class JsonDouble : public Value<JSON_NUMBER, double>{
-        int int_value() const override { return static_cast<int>(_value); }
-        double double_value() const override { return _value; }
+    class JsonString : public Value<JSON_STRING, string>{
+        string_view string_value() const override { return _value; }
       public:
-        explicit JsonDouble(double value) : Value(value){}
+        explicit JsonString(const string& value) : Value(value){}
+        explicit JsonString(string&& value) : Value(move(value)){}
     };
 
-    class JsonString : public Value<JSON_STRING, string>{
-        const string& string_value() const override { return _value; }
+    // 解析时创建的字符串, 内容和节点一样从请求的 memory_resource 分配
+    class ResourceString : public Value<JSON_STRING, pmr::string>{
+        string_view string_value() const override { return _value; }
       public:
-        explicit JsonString(const string& value) : Value(value){}
+        ResourceString(string_view value, pmr::memory_resource* resource) : Value(pmr::string(value, resource)){}
     };
 
     class JsonArray : public Value<JSON_ARRAY, Json::array>{
         const Json::array& array_value() const override { return _value; }
+        Json::array* mutable_array() override { return &_value; }
       public:
-        explicit JsonArray(Json::array value) : Value(value){}
+        explicit JsonArray(const Json::array& value) : Value(value){}
+        explicit JsonArray(Json::array&& value) : Value(move(value)){}
         const Json& operator[](size_t i) const override;
-        const size_t size() const override{ return _value.size(); }
+        size_t size() const override{ return _value.size(); }
     };
 
     class JsonObject : public Value<JSON_OBJECT, Json::object>{
         const Json::object& object_value() const override { return _value; }
+        Json::object* mutable_object() override { return &_value; }
       public:
-        explicit JsonObject(Json::object value) : Value(value){}
+        explicit JsonObject(const Json::object& value) : Value(value){}
+        explicit JsonObject(Json::object&& value) : Value(move(value)){}
         const Json& operator[](const string& key) const override;
-        const size_t size() const override{ return _value.size(); }
+        size_t size() const override{ return _value.size(); }
     };
 
     struct Statics {
-        const std::shared_ptr<JsonValue> null = make_shared<JsonNull>();
-        const std::shared_ptr<JsonValue> t = make_shared<JsonBoolean>(true);
-        const std::shared_ptr<JsonValue> f = make_shared<JsonBoolean>(false);
         const string empty_string;
-        const vector<Json> empty_vector;
-        const map<string, Json> empty_map;
+        const Json::array empty_vector;
+        const Json::object empty_map;
+        // 空字符串/空容器节点不可变, 所有 Json 共享同一份
+        const std::shared_ptr<JsonValue> empty_string_value = make_shared<JsonString>(empty_string);
+        const std::shared_ptr<JsonValue> empty_array_value = make_shared<JsonArray>(empty_vector);
+        const std::shared_ptr<JsonValue> empty_object_value = make_shared<JsonObject>(empty_map);
         Statics() {}
     };
 
@@ -201,60 +277,94 @@ namespace SparkJson
     }
 
     static const Json & static_null() {
-        // This has to be separate, not in Statics, because Json() accesses statics().null.
         static const Json json_null;
         return json_null;
     }  
 
-    Json::Json() : _value(make_shared<JsonNull>()){}
-    Json::Json(nullptr_t) : _value(make_shared<JsonNull>()){}
-    Json::Json(bool value) : _value(make_shared<JsonBoolean>(value)){}
-    Json::Json(int value) : _value(make_shared<JsonInt>(value)){}
-    Json::Json(double value) : _value(make_shared<JsonDouble>(value)){}
-    Json::Json(int64_t value) : _value(make_shared<JsonInt64_t>(value)){}
-    Json::Json(uint64_t value) : _value(make_shared<JsonUInt64_t>(value)){}
-    Json::Json(const string& value) : _value(make_shared<JsonString>(value)){}
-    Json::Json(const char* value) : _value(make_shared<JsonString>(value)){}
-    Json::Json(const Json::array& value) : _value(make_shared<JsonArray>(value)){}
-    Json::Json(Json::array&& value) : _value(make_shared<JsonArray>(move(value))){}
-    Json::Json(const Json::object& value) : _value(make_shared<JsonObject>(value)){}
-    Json::Json(Json::object&& value) : _value(make_shared<JsonObject>(move(value))){}
-    /*Json::Json(const Json& json) : _value(json._value), _errorCode(json._errorCode){
-        if(json.type() == JsonType::JSON_STRING){
-            std::cout << json.to_string() << std::endl;
-        }
-    }*/
-
-    const Json& JsonValue::operator[](size_t i) const{
-        return static_null();
+    Json::Json() : _uint64(0), _kind(KIND_NULL){}
+    Json::Json(nullptr_t) : _uint64(0), _kind(KIND_NULL){}
+    Json::Json(bool value) : _uint64(0), _kind(KIND_BOOL){ _bool = value; }
+    Json::Json(int value) : _uint64(0), _kind(KIND_INT){ _int = value; }
+    Json::Json(double value) : _double(value), _kind(KIND_DOUBLE){}
+    Json::Json(int64_t value) : _int64(value), _kind(KIND_INT64){}
+    Json::Json(uint64_t value) : _uint64(value), _kind(KIND_UINT64){}
+    Json::Json(const string& value)
+        : _value(value.empty() ? statics().empty_string_value : make_shared<JsonString>(value)), _kind(KIND_VALUE){}
+    Json::Json(string&& value)
+        : _value(value.empty() ? statics().empty_string_value : make_shared<JsonString>(move(value))), _kind(KIND_VALUE){}
+    Json::Json(const char* value)
+        : _value(*value == '\0' ? statics().empty_string_value : make_shared<JsonString>(value)), _kind(KIND_VALUE){}
+    Json::Json(const Json::array& value)
+        : _value(value.empty() ? statics().empty_array_value : make_shared<JsonArray>(value)), _kind(KIND_VALUE){}
+    Json::Json(Json::array&& value)
+        : _value(value.empty() ? statics().empty_array_value : make_shared<JsonArray>(move(value))), _kind(KIND_VALUE){}
+    Json::Json(const vector<Json>& value) : Json(Json::array(value.begin(), value.end())){}
+    Json::Json(vector<Json>&& value)
+        : Json(Json::array(make_move_iterator(value.begin()), make_move_iterator(value.end()))){}
+    Json::Json(const Json::object& value)
+        : _value(value.empty() ? statics().empty_object_value : make_shared<JsonObject>(value)), _kind(KIND_VALUE){}
+    Json::Json(Json::object&& value)
+        : _value(value.empty() ? statics().empty_object_value : make_shared<JsonObject>(move(value))), _kind(KIND_VALUE){}
+    Json::Json(shared_ptr<JsonValue> value) : _value(move(value)), _kind(KIND_VALUE){}
+
+    Json::Json(const Json& other) : _kind(other._kind), _errorCode(other._errorCode){
+        if(_kind == KIND_VALUE)
+            new (&_value) shared_ptr<JsonValue>(other._value);
+        else
+            _uint64 = other._uint64;
     }
 
-    const Json& JsonValue::operator[](const string& key) const{
-        return static_null();
+    Json::Json(Json&& other) noexcept : _kind(other._kind), _errorCode(other._errorCode){
+        if(_kind == KIND_VALUE){
+            new (&_value) shared_ptr<JsonValue>(move(other._value));
+            other._value.~shared_ptr();
+            other._uint64 = 0;
+            other._kind = KIND_NULL;
+        }
+        else
+            _uint64 = other._uint64;
     }
 
-    bool JsonValue::bool_value() const{
-        return false;
+    Json& Json::operator=(const Json& other){
+        // other 可能是自身的子节点, 先拷贝再释放
+        if(this != &other)
+            *this = Json(other);
+        return *this;
     }
-    
-    int JsonValue::int_value() const{
-        return 0;
+
+    Json& Json::operator=(Json&& other) noexcept{
+        if(this != &other){
+            Json tmp(move(other));
+            if(_kind == KIND_VALUE)
+                _value.~shared_ptr();
+            _kind = tmp._kind;
+            _errorCode = tmp._errorCode;
+            if(_kind == KIND_VALUE){
+                new (&_value) shared_ptr<JsonValue>(move(tmp._value));
+                tmp._value.~shared_ptr();
+                tmp._kind = KIND_NULL;
+            }
+            else
+                _uint64 = tmp._uint64;
+        }
+        return *this;
     }
 
-    int64_t JsonValue::int64_t_value() const{
-        return 0;
+    Json::~Json(){
+        if(_kind == KIND_VALUE)
+            _value.~shared_ptr();
     }
 
-    uint64_t JsonValue::uint64_t_value() const{
-        return 0;
+    const Json& JsonValue::operator[](size_t i) const{
+        return static_null();
     }
-    
-    double JsonValue::double_value() const{
-        return 0.0;
+
+    const Json& JsonValue::operator[](const string& key) const{
+        return static_null();
     }
-    
-    const std::string& JsonValue::string_value() const{
-        return statics().empty_string;
+
+    string_view JsonValue::string_value() const{
+        return string_view();
     }
     
     const Json::array& JsonValue::array_value() const{
@@ -266,15 +376,69 @@ namespace SparkJson
     }
 
     size_t Json::size() const{
-        return _value->size();
+        return _kind == KIND_VALUE ? _value->size() : 1;
     }
 
     JsonType Json::type() const{
-        return _value->type();
+        switch(_kind){
+            case KIND_NULL:  return JSON_NULL;
+            case KIND_BOOL:  return JSON_BOOL;
+            case KIND_VALUE: return _value->type();
+            default:         return JSON_NUMBER;
+        }
     }
 
     void Json::dump(string& out) const{
-        _value->dump(out);
+        dumpTo(out);
+    }
+
+    void Json::dump(JsonSink& out) const{
+        dumpTo(out);
+    }
+
+#ifdef SPARK_JSON_STATS
+    static void countNodes(const Json& json, JsonStats& stats, size_t depth){
+        JsonType type = json.type();
+        stats.nodes[type]++;
+        if(type == JSON_STRING)
+            stats.stringBytes += json.to_string_view().size();
+        else if(type == JSON_ARRAY || type == JSON_OBJECT)
+            stats.maxDepth = max(stats.maxDepth, depth);
+        if(type == JSON_ARRAY){
+            for(const Json& value : json.to_array())
+                countNodes(value, stats, depth + 1);
+        }
+        else if(type == JSON_OBJECT){
+            for(const auto& kv : json.to_object()){
+                stats.stringBytes += kv.first.size();
+                countNodes(kv.second, stats, depth + 1);
+            }
+        }
+    }
+#endif
+
+    void Json::dump(string& out, JsonStats& stats) const{
+        JsonStats* _stats = &stats;
+        size_t before = out.size();
+        {
+            SPARK_JSON_TIMER(dumpNanos);
+            dumpTo(out);
+        }
+        SPARK_JSON_STAT(_stats->outputBytes += out.size() - before; countNodes(*this, stats, 1));
+        (void)before;
+    }
+
+    template<typename Out>
+    void Json::dumpTo(Out& out) const{
+        switch(_kind){
+            case KIND_NULL:   out += "null"; break;
+            case KIND_BOOL:   SparkJson::dump(_bool, out); break;
+            case KIND_INT:    SparkJson::dump(_int, out); break;
+            case KIND_INT64:  SparkJson::dump(_int64, out); break;
+            case KIND_UINT64: SparkJson::dump(_uint64, out); break;
+            case KIND_DOUBLE: SparkJson::dump(_double, out); break;
+            case KIND_VALUE:  _value->dump(out); break;
+        }
     }
 
     const Json& JsonArray::operator[](size_t i) const{
@@ -283,139 +447,583 @@ namespace SparkJson
     }
 
     const Json& JsonObject::operator[](const string& key) const{
-        if(_value.count(key) == 0) return static_null();
-        return _value.find(key)->second;
+        auto it = _value.find(key);
+        if(it == _value.end()) return static_null();
+        return it->second;
+    }
+
+    // 超出整数范围的 double 直接转换是未定义行为: 截断到 T 的上下界, NaN 为 0
+    template<typename T>
+    static T fromDouble(double value){
+        if constexpr(is_floating_point<T>::value)
+            return static_cast<T>(value);
+        else{
+            if(std::isnan(value))
+                return 0;
+            if(value <= static_cast<double>(numeric_limits<T>::min()))
+                return numeric_limits<T>::min();
+            if(value >= static_cast<double>(numeric_limits<T>::max()))
+                return numeric_limits<T>::max();
+            return static_cast<T>(value);
+        }
+    }
+
+    template<typename T>
+    T Json::numberAs() const{
+        switch(_kind){
+            case KIND_INT:    return static_cast<T>(_int);
+            case KIND_INT64:  return static_cast<T>(_int64);
+            case KIND_UINT64: return static_cast<T>(_uint64);
+            case KIND_DOUBLE: return fromDouble<T>(_double);
+            default:          return 0;
+        }
     }
 
     bool Json::to_bool() const{
-        return _value->bool_value();
+        return _kind == KIND_BOOL && _bool;
     }
     
     int Json::to_int() const{
-        return _value->int_value();
+        return numberAs<int>();
     }
     
     int64_t Json::to_int64_t() const{
-        return _value->int64_t_value();
+        return numberAs<int64_t>();
     }
 
     uint64_t Json::to_uint64_t() const{
-        return _value->uint64_t_value();
+        return numberAs<uint64_t>();
     }
 
     double Json::to_double() const{
-        return _value->double_value();
+        return numberAs<double>();
     }
     
-    const std::string& Json::to_string() const{
-        return _value->string_value();
+    string Json::to_string() const{
+        return string(to_string_view());
+    }
+
+    string_view Json::to_string_view() const{
+        return _kind == KIND_VALUE ? _value->string_value() : string_view();
     }
     
     const Json::array& Json::to_array() const{
-        return _value->array_value();
+        return _kind == KIND_VALUE ? _value->array_value() : statics().empty_vector;
     }
 
     const Json::object& Json::to_object() const{
-        return _value->object_value();
+        return _kind == KIND_VALUE ? _value->object_value() : statics().empty_map;
     }
 
     const Json& Json::operator[](size_t i) const{
-        return (*_value)[i];
+        return _kind == KIND_VALUE ? (*_value)[i] : static_null();
     }
 
     const Json& Json::operator[](const std::string& key) const{
-        return (*_value)[key];
+        return _kind == KIND_VALUE ? (*_value)[key] : static_null();
+    }
+    // 写时复制: 只有独占的节点才原地修改, 否则复制一层到新节点.
+    // 复制 vector<Json> / FlatMap 只增加子节点的引用计数
+    Json::array& Json::mutableArray(){
+        if(_kind == KIND_VALUE && _value.use_count() == 1){
+            if(Json::array* values = _value->mutable_array())
+                return *values;
+        }
+        int code = _errorCode;
+        *this = Json(shared_ptr<JsonValue>(make_shared<JsonArray>(to_array())));
+        _errorCode = code;
+        return *_value->mutable_array();
+    }
+
+    Json::object& Json::mutableObject(){
+        if(_kind == KIND_VALUE && _value.use_count() == 1){
+            if(Json::object* values = _value->mutable_object())
+                return *values;
+        }
+        int code = _errorCode;
+        *this = Json(shared_ptr<JsonValue>(make_shared<JsonObject>(to_object())));
+        _errorCode = code;
+        return *_value->mutable_object();
+    }
+
+    Json* Json::mutableAt(size_t i){
+        if(type() != JSON_NULL && type() != JSON_ARRAY)
+            return nullptr;
+        Json::array& values = mutableArray();
+        if(i >= values.size())
+            values.resize(i + 1);
+        return &values[i];
+    }
+
+    Json* Json::mutableAt(const string& key){
+        if(type() != JSON_NULL && type() != JSON_OBJECT)
+            return nullptr;
+        return &mutableObject()[key];
+    }
+
+    bool Json::set(const string& key, Json value){
+        if(type() != JSON_NULL && type() != JSON_OBJECT)
+            return false;
+        mutableObject()[key] = move(value);
+        return true;
+    }
+
+    bool Json::push_back(Json value){
+        if(type() != JSON_NULL && type() != JSON_ARRAY)
+            return false;
+        mutableArray().push_back(move(value));
+        return true;
+    }
+
+    size_t Json::erase(const string& key){
+        if(type() != JSON_OBJECT || to_object().count(key) == 0)
+            return 0;
+        return mutableObject().erase(key);
+    }
+
+    bool Json::erase(size_t i){
+        if(type() != JSON_ARRAY || i >= size())
+            return false;
+        Json::array& values = mutableArray();
+        values.erase(values.begin() + i);
+        return true;
+    }
+
+    // key
+
+    JsonKey::JsonKey(string_view str, pmr::memory_resource* resource){
+        if(str.size() <= kInlineCapacity){
+            // 默认构造的 string_view 的 data() 为空指针, 不能交给 memcpy
+            if(!str.empty())
+                memcpy(_buf, str.data(), str.size());
+            _buf[kInlineCapacity] = static_cast<char>(str.size());
+            return;
+        }
+        const size_t bytes = offsetof(Rep, data) + str.size();
+        Rep* r = static_cast<Rep*>(resource ? resource->allocate(bytes, alignof(Rep)) : ::operator new(bytes));
+        new (&r->refs) atomic<size_t>(1);
+        r->resource = resource;
+        r->size = str.size();
+        memcpy(r->data, str.data(), str.size());
+        memcpy(_buf, &r, sizeof r);
+        _buf[kInlineCapacity] = static_cast<char>(kShared);
+    }
+
+    void JsonKey::release() noexcept{
+        if(shared() && rep()->refs.fetch_sub(1, memory_order_acq_rel) == 1){
+            Rep* r = rep();
+            r->refs.~atomic();
+            if(r->resource)
+                r->resource->deallocate(r, offsetof(Rep, data) + r->size, alignof(Rep));
+            else
+                ::operator delete(r);
+        }
+        _buf[kInlineCapacity] = 0;
+    }
+
+    JsonKey KeyPool::intern(string_view key){
+        if(key.size() <= JsonKey::kInlineCapacity)
+            return JsonKey(key);
+        auto it = _keys.find(key);
+        if(it != _keys.end())
+            return it->second;
+        JsonKey interned(key);
+        _keys.emplace(interned.view(), interned);
+        return interned;
+    }
+
+    // pointer
+
+    JsonPointer::JsonPointer(string_view pointer){
+        if(pointer.empty())
+            return;
+        if(pointer[0] != '/'){
+            _valid = false;
+            return;
+        }
+        size_t count = 0;
+        for(char ch : pointer)
+            count += ch == '/';
+        _tokens.reserve(count);
+        string token;
+        for(size_t pos = 1;; pos++){
+            if(pos == pointer.size() || pointer[pos] == '/'){
+                size_t index = kNotIndex;
+                // 下标不能有前导 0, "-" 表示数组末尾之后, 总是不存在
+                if(!token.empty() && (token[0] != '0' || token.size() == 1)){
+                    size_t n = 0;
+                    from_chars_result r = from_chars(token.data(), token.data() + token.size(), n);
+                    if(r.ec == errc() && r.ptr == token.data() + token.size())
+                        index = n;
+                }
+                _tokens.push_back(Token{ JsonKey(token), index });
+                token.clear();
+                if(pos == pointer.size())
+                    break;
+                continue;
+            }
+            char ch = pointer[pos];
+            if(ch == '~'){
+                char next = pos + 1 < pointer.size() ? pointer[pos + 1] : '\0';
+                if(next != '0' && next != '1'){
+                    _tokens.clear();
+                    _valid = false;
+                    return;
+                }
+                ch = next == '0' ? '~' : '/';
+                pos++;
+            }
+            token += ch;
+        }
+    }
+
+    const Json& JsonPointer::resolve(const Json& root) const{
+        if(!_valid)
+            return static_null();
+        const Json* node = &root;
+        for(const Token& token : _tokens){
+            switch(node->type()){
+                case JSON_OBJECT:{
+                    const Json::object& object = node->to_object();
+                    Json::object::const_iterator it = object.find(token.key.view());
+                    if(it == object.end())
+                        return static_null();
+                    node = &it->second;
+                    break;
+                }
+                case JSON_ARRAY:{
+                    const Json::array& array = node->to_array();
+                    if(token.index >= array.size())
+                        return static_null();
+                    node = &array[token.index];
+                    break;
+                }
+                default:
+                    return static_null();
+            }
+        }
+        return *node;
+    }
+
+    const Json& Json::at(const JsonPointer& pointer) const{
+        return pointer.resolve(*this);
+    }
+
+    // sink
+
+    JsonSink::JsonSink(size_t bufferSize)
+        : _buffer(new char[bufferSize]),
+          _cur(_buffer.get()),
+          _end(_buffer.get() + bufferSize){}
+
+    JsonSink::~JsonSink(){}
+
+    void JsonSink::flush(){
+        size_t len = _cur - _buffer.get();
+        _cur = _buffer.get();
+        if(len > 0)
+            write(_buffer.get(), len);
+    }
+
+    void JsonSink::appendSlow(const char* data, size_t len){
+        flush();
+        // 比缓冲区还大的片段直接写出, 不经过缓冲区
+        if(len >= static_cast<size_t>(_end - _cur)){
+            write(data, len);
+            return;
+        }
+        memcpy(_cur, data, len);
+        _cur += len;
+    }
+
+    FdSink::~FdSink(){
+        flush();
     }
+
+    void FdSink::write(const char* data, size_t len){
+        while(len > 0 && _error == 0){
+#ifdef _WIN32
+            int n = ::_write(_fd, data, static_cast<unsigned>(len));
+#else
+            ssize_t n = ::write(_fd, data, len);
+#endif
+            if(n < 0){
+                if(errno != EINTR)
+                    _error = errno;
+                continue;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+
+    FileSink::~FileSink(){
+        flush();
+    }
+
+    void FileSink::write(const char* data, size_t len){
+        if(fwrite(data, 1, len, _file) != len)
+            _error = true;
+    }
+
+    CallbackSink::~CallbackSink(){
+        flush();
+    }
+
+    void CallbackSink::write(const char* data, size_t len){
+        _callback(data, len);
+    }
+
+    // file
+
+    MappedFile::MappedFile(const string& path){
+#ifdef _WIN32
+        FILE* file = fopen(path.c_str(), "rb");
+        if(!file){
+            _error = errno;
+            return;
+        }
+        char chunk[64 * 1024];
+        size_t n;
+        while((n = fread(chunk, 1, sizeof chunk, file)) > 0)
+            _buffer.append(chunk, n);
+        if(ferror(file))
+            _error = EIO;
+        fclose(file);
+#else
+        int fd;
+        do{
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }while(fd < 0 && errno == EINTR);
+        if(fd < 0){
+            _error = errno;
+            return;
+        }
+        struct stat st;
+        const bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+        if(regular){
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED){
+                madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                _data = static_cast<const char*>(p);
+                _size = static_cast<size_t>(st.st_size);
+                _mapped = true;
+                ::close(fd);
+                return;
+            }
+        }
+        // 管道, 特殊文件或无法映射时分块读取; 普通文件按大小一次分配到位
+        if(regular)
+            _buffer.reserve(static_cast<size_t>(st.st_size));
+        char chunk[64 * 1024];
+        for(;;){
+            ssize_t n = ::read(fd, chunk, sizeof chunk);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+                _error = errno;
+            if(n <= 0)
+                break;
+            _buffer.append(chunk, n);
+        }
+        ::close(fd);
+#endif
+        _data = _buffer.data();
+        _size = _buffer.size();
+    }
+
+    MappedFile::~MappedFile(){
+#ifndef _WIN32
+        if(_mapped)
+            munmap(const_cast<char*>(_data), _size);
+#endif
+    }
+
+    // arena
+
+    struct Arena::Block{
+        Block* next;
+        size_t size;
+    };
+
+    Arena::Arena(size_t blockSize, pmr::memory_resource* upstream) : _upstream(upstream), _blockSize(blockSize){}
+
+    Arena::~Arena(){
+        release();
+    }
+
+    void Arena::newBlock(size_t minSize){
+        size_t size = max(_blockSize, minSize + sizeof(Block) + alignof(max_align_t));
+        Block* block = static_cast<Block*>(_upstream->allocate(size, alignof(max_align_t)));
+        block->next = _head;
+        block->size = size;
+        _head = block;
+        _cur = reinterpret_cast<char*>(block + 1);
+        _end = reinterpret_cast<char*>(block) + size;
+        _blockCount++;
+    }
+
+    void* Arena::allocate(size_t size, size_t align){
+        uintptr_t p = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t)(align - 1);
+        if(_cur == nullptr || p + size > reinterpret_cast<uintptr_t>(_end)){
+            newBlock(size + align);
+            p = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        _cur = reinterpret_cast<char*>(p + size);
+        _bytesUsed += size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void Arena::release(){
+        while(_head){
+            Block* next = _head->next;
+            _upstream->deallocate(_head, _head->size, alignof(max_align_t));
+            _head = next;
+        }
+        _cur = _end = nullptr;
+        _blockCount = 0;
+        _bytesUsed = 0;
+    }
+
     // parser
 
+    // 递归下降解析, 通过 Handler 的回调输出事件. 构建 DOM 时 Handler 为 DomBuilder,
+    // 对外的 SAX 接口为 JsonHandler. 回调返回 false 时停止解析
+    template<typename Handler>
     class Parser{
       public:
-        Parser(const string& value) 
+        // resource 用于转义字符串的解码缓冲区, 为空时使用默认的 memory_resource
+        Parser(string_view value, Handler& handler, pmr::memory_resource* resource = nullptr)
             : _pos(0),
               _value(value),
-              _code(PARSE_EXPECT_VALUE){}
+              _code(PARSE_EXPECT_VALUE),
+              _handler(handler),
+              _buffer(resource ? resource : pmr::get_default_resource()){}
 
-        Json parse(){
+        ParseCode parse(){
             parseWhitespace();
-            Json json(parseValue());
-            if(_code == PARSE_OK){
+            if(parseValue()){
                 parseWhitespace();
-                if(_value.length() > _pos){
+                if(_value.length() > _pos)
                     _code = PARSE_ROOT_NOT_SINGULAR;
-                    return Json();
-                }
             }
-            return json;
+            return _code;
         }
+
+        // 越界时返回 '\0', 调用者的缓冲区不需要以 '\0' 结尾
+        char peek(size_t offset = 0) const{
+            return _pos + offset < _value.length() ? _value[_pos + offset] : '\0';
+        }
+
+        bool eof() const { return _pos >= _value.length(); }
+        size_t position() const { return _pos; }
+        void seek(size_t pos) { _pos = pos; }
         
+        void setStats(JsonStats* stats) { _stats = stats; }
+
         void parseWhitespace(){
-            if(_pos >= _value.length())
-                return;
-            
-            while(_value[_pos] == ' ' || _value[_pos] == '\t' || _value[_pos] == '\r' || _value[_pos] == '\n'){
+            while(!eof() && (_value[_pos] == ' ' || _value[_pos] == '\t' || _value[_pos] == '\r' || _value[_pos] == '\n')){
                     _pos++;
             }
         }
 
-        Json parseLiteral(const string& expect, Json expect_json){
+        bool emit(bool ok){
+            _code = ok ? PARSE_OK : PARSE_CANCELLED;
+            return ok;
+        }
+
+        bool parseLiteral(string_view expect){
             size_t len = expect.length();
             assert(len > 0);
-            bool ret = _value.substr(_pos, len).compare(expect) == 0;
+            bool ret = _value.substr(_pos, len) == expect;
             _pos += len;
-            if(!ret){
-               _code = PARSE_INVALID_VALUE;
-                return Json();
-            }
-            _code = PARSE_OK;
-            return expect_json;
+            _code = ret ? PARSE_OK : PARSE_INVALID_VALUE;
+            return ret;
+        }
+
+        static bool isDigit(char ch){
+            return ch >= '0' && ch <= '9';
         }
 
-        Json parseNumber(){
+        static bool isWhitespace(char ch){
+            return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+        }
+
+        bool parseNumber(){
+            SPARK_JSON_TIMER(numberNanos);
             size_t start_pos = _pos;
-            if(_value[_pos] == '-')
+            bool negative = peek() == '-';
+            if(negative)
                 _pos++;
-            if(_value[_pos] == '0' && isdigit(_value[_pos + 1])){
+            if(!isDigit(peek())){
+                _code = PARSE_INVALID_VALUE;
+                return false;
+            }
+            if(peek() == '0' && isDigit(peek(1))){
                 _code = PARSE_INVALID_VALUE;
-                return Json(0);
+                return false;
             }
 
-            for(; isdigit(_value[_pos]); _pos++);
+            // 扫描整数部分时顺便累加, 纯整数且不溢出时不再走浮点转换
+            uint64_t u = 0;
+            bool overflow = false;
+            for(; isDigit(peek()); _pos++){
+                unsigned d = peek() - '0';
+                if(u > (UINT64_MAX - d) / 10)
+                    overflow = true;
+                else
+                    u = u * 10 + d;
+            }
+            bool integer = true;
 
-            if(_value[_pos] == '.'){
+            if(peek() == '.'){
                 _pos++;
-                if(!isdigit(_value[_pos])){
+                integer = false;
+                if(!isDigit(peek())){
                     _code = PARSE_INVALID_VALUE;
-                    return Json(0);
+                    return false;
                 }
-                else for(; isdigit(_value[_pos]); _pos++);
+                else for(; isDigit(peek()); _pos++);
             } 
 
-            if(_value[_pos] == 'e' || _value[_pos] == 'E'){
+            if(peek() == 'e' || peek() == 'E'){
                 _pos++;
-                if(_value[_pos] == '+' || _value[_pos] == '-')  _pos++;
-                if(!isdigit(_value[_pos])){
+                integer = false;
+                if(peek() == '+' || peek() == '-')  _pos++;
+                if(!isDigit(peek())){
                     _code = PARSE_INVALID_VALUE;
-                    return Json(0);
+                    return false;
                 }
-                for(; isdigit(_value[_pos]); _pos++);
+                for(; isDigit(peek()); _pos++);
             }
 
-            double n;
-            try{
-                n = stod(_value.substr(start_pos, _pos));
+            if(integer && !overflow){
+                if(!negative){
+                    if(u <= static_cast<uint64_t>(INT64_MAX))
+                        return emit(_handler.on_int64(static_cast<int64_t>(u)));
+                    return emit(_handler.on_uint64(u));
+                }
+                // "-0" 保留为 double 的 -0.0
+                if(u != 0 && u <= static_cast<uint64_t>(INT64_MAX) + 1)
+                    return emit(_handler.on_int64(-static_cast<int64_t>(u - 1) - 1));
             }
-            catch(const std::out_of_range& oor){
+
+            // from_chars 不分配内存也不受 locale 影响
+            double n;
+            const char* first = _value.data() + start_pos;
+            if(from_chars(first, _value.data() + _pos, n).ec == errc::result_out_of_range){
                 _code = PARSE_NUMBER_TOO_BIG;
-                return Json(0);
+                return false;
             }
-            _code = PARSE_OK;
-            return Json(n);
+            return emit(_handler.on_number(n));
         }
 
         bool parseHex4(unsigned* u){
             *u = 0;
             for(int i = 0; i < 4; i++){
                 *u <<= 4;
+                if(eof())
+                    return false;
                 char ch = _value[_pos++];
                 if      (ch >= '0' && ch <= '9')  *u |= ch - '0';
                 else if (ch >= 'A' && ch <= 'F')  *u |= ch - ('A' - 10);
@@ -425,7 +1033,7 @@ namespace SparkJson
             return true;
         }
 
-        void encodeUtf8(unsigned u, string& out){
+        void encodeUtf8(unsigned u, pmr::string& out){
             if(u <= 0x7F){
                 out += u & 0xFF;
             }
@@ -447,160 +1055,243 @@ namespace SparkJson
             }
         }
 
-        string parseString(){
-            assert(_value[_pos++] == '\"');
-            string out;
-            unsigned u, u2;
+        // 没有转义时 out 直接指向输入, 否则指向解码后的 _buffer,
+        // 在下一次 parseString 之前有效
+        bool parseString(string_view& out){
+            SPARK_JSON_TIMER(stringNanos);
+            assert(peek() == '\"');
+            _pos++;
+            const char* data = _value.data();
+            const char* end = data + _value.length();
+            const char* run = data + _pos;
+            const char* special = findSpecialChar(run, end, '\"');
+            if(special != end && *special == '\"'){
+                out = string_view(run, special - run);
+                _pos = special - data + 1;
+                return true;
+            }
 
+            unsigned u, u2;
+            _buffer.clear();
             for(;;){
+                // 跳过不需要处理的连续片段, 整段追加
+                _buffer.append(run, special - run);
+                _pos = special - data;
+                if(eof()){
+                    _code = PARSE_MISS_QUOTATION_MARK;
+                    return false;
+                }
                 char ch = _value[_pos++];
                 switch(ch){
                     case '\"':
-                        _code = PARSE_OK;
-                        //out += '\0';
-                        return out;
+                        out = _buffer;
+                        return true;
                     case '\\':
+                        if(eof()){
+                            _code = PARSE_MISS_QUOTATION_MARK;
+                            return false;
+                        }
                         switch(_value[_pos++]){
-                            case '\"': out += '\"'; break; 
-                            case '\\': out += '\\'; break;
-                            case '/':  out += '/'; break;
-                            case 'b':  out += '\b'; break;
-                            case 'f':  out += '\f'; break;
-                            case 'n':  out += '\n'; break;
-                            case 'r':  out += '\r'; break;
-                            case 't':  out += '\t'; break;
+                            case '\"': _buffer += '\"'; break; 
+                            case '\\': _buffer += '\\'; break;
+                            case '/':  _buffer += '/'; break;
+                            case 'b':  _buffer += '\b'; break;
+                            case 'f':  _buffer += '\f'; break;
+                            case 'n':  _buffer += '\n'; break;
+                            case 'r':  _buffer += '\r'; break;
+                            case 't':  _buffer += '\t'; break;
                             case 'u':
                                 if(!parseHex4(&u)){
                                     _code = PARSE_INVALID_UNICODE_HEX;
-                                    return "";
+                                    return false;
                                 }
                                 if(u >= 0xD800 && u <= 0xDBFF){
-                                    if(_value[_pos++] != '\\'){
+                                    if(peek() != '\\'){
                                         _code = PARSE_INVALID_UNICODE_SURROGATE;
-                                        return "";
+                                        return false;
                                     }
-                                    if(_value[_pos++] != 'u'){
+                                    _pos++;
+                                    if(peek() != 'u'){
                                         _code = PARSE_INVALID_UNICODE_SURROGATE;
-                                        return "";
+                                        return false;
                                     }
+                                    _pos++;
                                     if(!parseHex4(&u2)){
                                         _code = PARSE_INVALID_UNICODE_HEX;
-                                        return "";
+                                        return false;
                                     }
                                     if(u2 < 0xDC00 || u2 > 0xDFFF){
                                         _code = PARSE_INVALID_UNICODE_SURROGATE;
-                                        return "";
+                                        return false;
                                     }
                                     u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
                                 }
-                                encodeUtf8(u, out);
+                                encodeUtf8(u, _buffer);
                                 break;
                             default:
                                 _code = PARSE_INVALID_STRING_ESCAPE;
-                                return "";
+                                return false;
                         }
                         break;
-                    case '\0':
-                        _code = PARSE_MISS_QUOTATION_MARK;
-                        return "";
                     default:
-                        if(static_cast<unsigned char>(ch) < 0x20){
-                            _code = PARSE_INVALID_STRING_CHAR;
-                            return "";
-                        }
-                        out += ch;
+                        // findSpecialChar 只会停在控制字符上
+                        _code = PARSE_INVALID_STRING_CHAR;
+                        return false;
                 }
+                run = data + _pos;
+                special = findSpecialChar(run, end, '\"');
             }
         }
 
-        Json parseObject(){
-            assert(_value[_pos++] == '{');
-            map<string, Json> out;
+        bool parseObject(){
+            assert(peek() == '{');
+            _pos++;
+            if(!emit(_handler.on_start_object()))
+                return false;
             parseWhitespace();
-            if(_value[_pos] == '}'){
+            if(peek() == '}'){
                 _pos++;
-                _code = PARSE_OK;
-                return out;
+                return emit(_handler.on_end_object());
             }
 
             for(;;){
-                string key = parseString();
-                if(_code != PARSE_OK){
-                    return Json();
+                if(peek() != '\"'){
+                    _code = PARSE_MISS_KEY;
+                    return false;
                 }
+                string_view key;
+                if(!parseString(key) || !emit(_handler.on_key(key)))
+                    return false;
 
                 parseWhitespace();
-                if(_value[_pos++] != ':'){
+                if(peek() != ':'){
                     _code = PARSE_MISS_COLON;
-                    return Json();
+                    return false;
                 }
+                _pos++;
 
                 parseWhitespace();
-                Json v = parseValue();
-                if(_code != PARSE_OK){
-                    return Json();
-                }
-                out[key] = v;
+                if(!parseValue())
+                    return false;
 
                 parseWhitespace();
-                if(_value[_pos] == '}'){
+                if(peek() == '}'){
                     _pos++;
-                    break;
+                    return emit(_handler.on_end_object());
                 }
-                else if(_value[_pos] == ','){
+                else if(peek() == ','){
                     _pos++;
                     parseWhitespace();
                 }
                 else{
                     _code = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-                    return Json();
+                    return false;
                 }
             }
-            return out;
         }
 
-        Json parseArray(){
-            assert(_value[_pos++] == '[');
-            vector<Json> out;
+        bool parseArray(){
+            assert(peek() == '[');
+            _pos++;
+            if(!emit(_handler.on_start_array()))
+                return false;
             parseWhitespace();
-            if(_value[_pos] == ']'){
+            if(peek() == ']'){
                 _pos++;
-                _code = PARSE_OK;
-                return out;
+                return emit(_handler.on_end_array());
             }
             for(;;){
-                Json v = parseValue();
-                if(_code != PARSE_OK){
-                    return Json();
-                }
-                out.push_back(v);
+                if(!parseValue())
+                    return false;
 
                 parseWhitespace();
-                if(_value[_pos] == ']'){
+                if(peek() == ']'){
                     _pos++;
-                    break;
+                    return emit(_handler.on_end_array());
                 }
-                else if(_value[_pos] == ','){
+                else if(peek() == ','){
                     _pos++;
                     parseWhitespace();
                 }
                 else{
                     _code = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-                    return Json();
+                    return false;
+                }
+            }
+        }
+
+        // 跳过一个值, 不回调 handler. 只匹配括号和字符串边界, 不校验内容
+        bool skipValue(){
+            char ch = peek();
+            if(ch == '\"')
+                return skipString();
+            if(ch != '{' && ch != '['){
+                size_t start = _pos;
+                while(!eof() && !isWhitespace(_value[_pos]) && _value[_pos] != ','
+                        && _value[_pos] != '}' && _value[_pos] != ']')
+                    _pos++;
+                _code = _pos > start ? PARSE_OK : eof() ? PARSE_EXPECT_VALUE : PARSE_INVALID_VALUE;
+                return _code == PARSE_OK;
+            }
+            size_t depth = 0;
+            while(!eof()){
+                char c = _value[_pos];
+                if(c == '\"'){
+                    if(!skipString())
+                        return false;
+                    continue;
+                }
+                if(c == '{' || c == '[')
+                    depth++;
+                else if((c == '}' || c == ']') && --depth == 0){
+                    _pos++;
+                    _code = PARSE_OK;
+                    return true;
+                }
+                _pos++;
+            }
+            _code = ch == '{' ? PARSE_MISS_COMMA_OR_CURLY_BRACKET : PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            return false;
+        }
+
+        bool skipString(){
+            assert(peek() == '\"');
+            const char* data = _value.data();
+            const char* end = data + _value.length();
+            const char* p = data + _pos + 1;
+            for(;;){
+                p = findSpecialChar(p, end, '\"');
+                if(p == end){
+                    _pos = _value.length();
+                    _code = PARSE_MISS_QUOTATION_MARK;
+                    return false;
                 }
+                if(*p == '\"')
+                    break;
+                p += *p == '\\' ? 2 : 1;
+                if(p > end)
+                    p = end;
             }
-            return out;
+            _pos = p - data + 1;
+            _code = PARSE_OK;
+            return true;
         }
 
-        Json parseValue(){
+        bool parseValue(){
+            if(eof()){
+                _code = PARSE_EXPECT_VALUE;
+                return false;
+            }
             switch(_value[_pos]){
-                case 'n': return parseLiteral("null", nullptr);
-                case 't': return parseLiteral("true", true);
-                case 'f': return parseLiteral("false", false);
-                case '"': return parseString();
+                case 'n': return parseLiteral("null") && emit(_handler.on_null());
+                case 't': return parseLiteral("true") && emit(_handler.on_bool(true));
+                case 'f': return parseLiteral("false") && emit(_handler.on_bool(false));
+                case '"':{
+                    string_view s;
+                    return parseString(s) && emit(_handler.on_string(s));
+                }
                 case '{': return parseObject();
                 case '[': return parseArray();
-                case '\0': return Json();
                 default:
                     return parseNumber();
             }
@@ -609,15 +1300,1748 @@ namespace SparkJson
         ParseCode getCode() const { return _code; }
       private:
         size_t _pos;
-        string _value;
+        string_view _value;
         ParseCode _code;
+        Handler& _handler;
+        pmr::string _buffer;
+        JsonStats* _stats = nullptr;
     };
 
-    Json Json::parse(const string& str){
-        Parser parser(str);
-        Json json = parser.parse(); 
-        json.setErrorCode(parser.getCode());
-        return json;
+    struct LazyDocument;
+
+    // 惰性解析的容器节点, 第一次访问时才创建直接子节点, 子容器仍然是惰性的
+    class LazyValue : public JsonValue{
+      public:
+        LazyValue(shared_ptr<const LazyDocument> doc, size_t index) : _doc(move(doc)), _index(index){}
+
+      protected:
+        size_t size() const override { return value().size(); }
+        JsonType type() const override;
+        void dump(string& out) const override { value().dump(out); }
+        void dump(JsonSink& out) const override { value().dump(out); }
+        const Json::array& array_value() const override { return value().to_array(); }
+        const Json::object& object_value() const override { return value().to_object(); }
+        const Json& operator[](size_t i) const override { return value()[i]; }
+        const Json& operator[](const string& key) const override { return value()[key]; }
+
+      private:
+        const Json& value() const;
+
+        shared_ptr<const LazyDocument> _doc;
+        size_t _index;
+        mutable once_flag _once;
+        mutable Json _value;
+    };
+
+    // 把 Parser 的事件组装成 Json 树. 子节点先压入 _values,
+    // 容器结束时元素个数已知, 再一次性移动到容器中
+    class DomBuilder{
+      public:
+        explicit DomBuilder(const ParseOptions& options = ParseOptions())
+            : _resource(options.arena ? options.arena : options.resource),
+              _preserveOrder(options.preserveOrder),
+              _keyPool(options.keyPool),
+              _stats(options.stats),
+              _values(tempResource(options)),
+              _keys(tempResource(options)),
+              _frames(tempResource(options)){
+            _values.reserve(kStackReserve);
+            _keys.reserve(kStackReserve);
+            _frames.reserve(kStackReserve);
+        }
+
+        bool on_null(){ SPARK_JSON_STAT(_stats->nodes[JSON_NULL]++); _values.emplace_back(); return true; }
+        bool on_int(int value){ SPARK_JSON_STAT(_stats->nodes[JSON_NUMBER]++); _values.emplace_back(value); return true; }
+        bool on_bool(bool value){ SPARK_JSON_STAT(_stats->nodes[JSON_BOOL]++); _values.emplace_back(value); return true; }
+        bool on_int64(int64_t value){ SPARK_JSON_STAT(_stats->nodes[JSON_NUMBER]++); _values.emplace_back(value); return true; }
+        bool on_uint64(uint64_t value){ SPARK_JSON_STAT(_stats->nodes[JSON_NUMBER]++); _values.emplace_back(value); return true; }
+        bool on_number(double value){ SPARK_JSON_STAT(_stats->nodes[JSON_NUMBER]++); _values.emplace_back(value); return true; }
+
+        bool on_string(string_view value){
+            SPARK_JSON_TIMER(buildNanos);
+            SPARK_JSON_STAT(_stats->nodes[JSON_STRING]++; _stats->stringBytes += value.size());
+            if(value.empty())
+                _values.push_back(Json(statics().empty_string_value));
+            else if(_resource)
+                _values.push_back(makeValue<ResourceString>(value, _resource));
+            else
+                _values.push_back(makeValue<JsonString>(string(value)));
+            return true;
+        }
+
+        bool on_key(string_view key){
+            SPARK_JSON_STAT(_stats->stringBytes += key.size());
+            if(_keyPool)
+                _keys.push_back(_keyPool->intern(key));
+            else
+                _keys.emplace_back(key, _resource);
+            return true;
+        }
+
+        // 惰性解析: 用尚未展开的容器占位
+        bool on_lazy(shared_ptr<const LazyDocument> doc, size_t index){
+            _values.push_back(makeValue<LazyValue>(move(doc), index));
+            return true;
+        }
+
+        bool on_start_object(){
+            _frames.push_back(_values.size());
+            SPARK_JSON_STAT(_stats->maxDepth = max(_stats->maxDepth, _frames.size()));
+            return true;
+        }
+
+        bool on_end_object(){
+            SPARK_JSON_TIMER(buildNanos);
+            SPARK_JSON_STAT(_stats->nodes[JSON_OBJECT]++);
+            size_t start = _frames.back();
+            _frames.pop_back();
+            size_t count = _values.size() - start;
+            if(count == 0){
+                _values.push_back(Json(statics().empty_object_value));
+                return true;
+            }
+            SPARK_JSON_STAT(_stats->allocations++);
+            Json::object::container_type entries(containerResource());
+            entries.reserve(count);
+            size_t keyStart = _keys.size() - count;
+            for(size_t i = 0; i < count; i++)
+                entries.emplace_back(move(_keys[keyStart + i]), move(_values[start + i]));
+            _keys.erase(_keys.begin() + keyStart, _keys.end());
+            _values.erase(_values.begin() + start, _values.end());
+            _values.push_back(makeValue<JsonObject>(Json::object(move(entries), _preserveOrder)));
+            return true;
+        }
+
+        bool on_start_array(){
+            _frames.push_back(_values.size());
+            SPARK_JSON_STAT(_stats->maxDepth = max(_stats->maxDepth, _frames.size()));
+            return true;
+        }
+
+        bool on_end_array(){
+            SPARK_JSON_TIMER(buildNanos);
+            SPARK_JSON_STAT(_stats->nodes[JSON_ARRAY]++);
+            size_t start = _frames.back();
+            _frames.pop_back();
+            if(start == _values.size()){
+                _values.push_back(Json(statics().empty_array_value));
+                return true;
+            }
+            SPARK_JSON_STAT(_stats->allocations++);
+            Json::array out(make_move_iterator(_values.begin() + start), make_move_iterator(_values.end()), containerResource());
+            _values.erase(_values.begin() + start, _values.end());
+            _values.push_back(makeValue<JsonArray>(move(out)));
+            return true;
+        }
+
+        // 解析失败时返回 null; 根节点数字转换失败时与旧行为一致返回 0
+        Json result(ParseCode code){
+            Json json;
+            if(code == PARSE_OK)
+                json = move(_values.back());
+            else if(code == PARSE_NUMBER_TOO_BIG && _frames.empty())
+                json = Json(0);
+            json.setErrorCode(code);
+            return json;
+        }
+
+      private:
+        // 工作栈预留的容量, 小文档解析过程中不需要扩容
+        static const size_t kStackReserve = 32;
+
+        // 节点和控制块一起从 _resource 分配; arena 的释放为空操作
+        template<typename T, typename... Args>
+        Json makeValue(Args&&... args){
+            SPARK_JSON_STAT(_stats->allocations++);
+            if(_resource)
+                return Json(allocate_shared<T>(pmr::polymorphic_allocator<T>(_resource), forward<Args>(args)...));
+            return Json(make_shared<T>(forward<Args>(args)...));
+        }
+
+        pmr::memory_resource* containerResource() const{
+            return _resource ? _resource : pmr::get_default_resource();
+        }
+
+        // 工作栈随文档增长并反复扩容, 不放进只增不减的 arena
+        static pmr::memory_resource* tempResource(const ParseOptions& options){
+            return options.resource ? options.resource : pmr::get_default_resource();
+        }
+
+        pmr::memory_resource* _resource;
+        bool _preserveOrder;
+        KeyPool* _keyPool;
+        JsonStats* _stats;
+        pmr::vector<Json> _values;
+        pmr::vector<JsonKey> _keys;
+        pmr::vector<size_t> _frames;
+    };
+
+    // extractor
+
+    size_t JsonExtractor::add(const JsonPointer& path){
+        if(_nodes.empty())
+            _nodes.push_back(Node{ JsonKey(), kNone, kNone, {} });
+        if(!path.valid()){
+            _values.emplace_back();
+            return _values.size() - 1;
+        }
+        size_t n = 0;
+        for(const JsonPointer::Token& token : path._tokens){
+            size_t next = kNone;
+            for(size_t child : _nodes[n].children)
+                if(_nodes[child].key == token.key)
+                    next = child;
+            if(next == kNone){
+                next = _nodes.size();
+                _nodes.push_back(Node{ token.key, token.index, kNone, {} });
+                _nodes[n].children.push_back(next);
+            }
+            n = next;
+        }
+        if(_nodes[n].slot == kNone){
+            _nodes[n].slot = _values.size();
+            _values.emplace_back();
+        }
+        return _nodes[n].slot;
+    }
+
+    // 沿路径组成的树下降, 标量目标交给 Parser 解析, 其余的值直接跳过
+    struct JsonExtractor::Walker{
+        Walker(JsonExtractor& extractor, string_view text)
+            : nodes(extractor._nodes), values(extractor._values), lastWins(extractor._lastDuplicateWins),
+              text(text), parser(text, *this){}
+
+        // Parser 的回调, 写入当前的目标
+        bool on_null() { return scalar(Json(), JSON_NULL); }
+        bool on_bool(bool value) { return scalar(Json(value), JSON_BOOL); }
+        bool on_int64(int64_t value) { return scalar(Json(value), JSON_NUMBER); }
+        bool on_uint64(uint64_t value) { return scalar(Json(value), JSON_NUMBER); }
+        bool on_number(double value) { return scalar(Json(value), JSON_NUMBER); }
+        bool on_string(string_view value){
+            // 有转义时 value 指向 Parser 的缓冲区, 需要保存一份
+            if(value.data() < text.data() || value.data() >= text.data() + text.size()){
+                current->_storage.assign(value.data(), value.size());
+                value = current->_storage;
+            }
+            current->_string = value;
+            current->_type = JSON_STRING;
+            return true;
+        }
+        bool on_key(string_view) { return true; }
+        bool on_start_object() { return true; }
+        bool on_end_object() { return true; }
+        bool on_start_array() { return true; }
+        bool on_end_array() { return true; }
+
+        bool scalar(Json value, JsonType type){
+            current->_scalar = value;
+            current->_type = type;
+            return true;
+        }
+
+        ParseCode run(){
+            // 保留 _storage 的容量, 反复提取时不需要重新分配
+            for(Value& v : values)
+                clear(v);
+            remaining = 0;
+            for(Node& node : nodes){
+                node.visited = false;
+                remaining += node.slot != kNone;
+            }
+            if(remaining == 0)
+                return PARSE_OK;
+            parser.parseWhitespace();
+            if(!value(0))
+                return code;
+            parser.parseWhitespace();
+            return parser.eof() ? PARSE_OK : PARSE_ROOT_NOT_SINGULAR;
+        }
+
+        static void clear(Value& v){
+            v._found = false;
+            v._type = JSON_NULL;
+            v._scalar = Json();
+            v._string = v._raw = string_view();
+        }
+
+        // lastWins 时重复的键再次进入同一节点, 与 Json::parse 一样以后出现的为准,
+        // 先前在这棵子树中找到的结果全部作废
+        void reset(size_t n){
+            if(!nodes[n].visited)
+                return;
+            nodes[n].visited = false;
+            if(nodes[n].slot != kNone)
+                clear(values[nodes[n].slot]);
+            for(size_t c : nodes[n].children)
+                reset(c);
+        }
+
+        // 返回 false 表示出错或所有目标都已找到, 此时 code 为最终结果
+        bool value(size_t n){
+            size_t slot = nodes[n].slot;
+            if(lastWins){
+                reset(n);
+                nodes[n].visited = true;
+            }
+            else if(slot != kNone && values[slot]._found)
+                slot = kNone;
+            if(parser.eof())
+                return fail(PARSE_EXPECT_VALUE);
+            size_t start = parser.position();
+            char ch = parser.peek();
+            bool container = ch == '{' || ch == '[';
+            if(slot != kNone && !container){
+                current = &values[slot];
+                if(!parser.parseValue())
+                    return fail(parser.getCode());
+                return found(slot, start);
+            }
+            if(!container || nodes[n].children.empty()){
+                if(!parser.skipValue())
+                    return fail(parser.getCode());
+            }
+            else if(!(ch == '{' ? object(n) : array(n)))
+                return false;
+            if(slot == kNone)
+                return true;
+            values[slot]._type = ch == '{' ? JSON_OBJECT : JSON_ARRAY;
+            return found(slot, start);
+        }
+
+        bool found(size_t slot, size_t start){
+            values[slot]._found = true;
+            values[slot]._raw = text.substr(start, parser.position() - start);
+            if(!lastWins && --remaining == 0)
+                return fail(PARSE_OK);
+            return true;
+        }
+
+        bool fail(ParseCode c){
+            code = c;
+            return false;
+        }
+
+        size_t child(size_t n, string_view key) const{
+            for(size_t c : nodes[n].children)
+                if(nodes[c].key.view() == key)
+                    return c;
+            return kNone;
+        }
+
+        size_t child(size_t n, size_t index) const{
+            for(size_t c : nodes[n].children)
+                if(nodes[c].index == index)
+                    return c;
+            return kNone;
+        }
+
+        bool member(size_t c){
+            parser.parseWhitespace();
+            return c != kNone ? value(c) : (parser.skipValue() || fail(parser.getCode()));
+        }
+
+        bool object(size_t n){
+            parser.seek(parser.position() + 1);
+            parser.parseWhitespace();
+            if(parser.peek() == '}'){
+                parser.seek(parser.position() + 1);
+                return true;
+            }
+            for(;;){
+                if(parser.peek() != '\"')
+                    return fail(PARSE_MISS_KEY);
+                string_view key;
+                if(!parser.parseString(key))
+                    return fail(parser.getCode());
+                size_t c = child(n, key);
+                parser.parseWhitespace();
+                if(parser.peek() != ':')
+                    return fail(PARSE_MISS_COLON);
+                parser.seek(parser.position() + 1);
+                if(!member(c))
+                    return false;
+                parser.parseWhitespace();
+                char ch = parser.peek();
+                parser.seek(parser.position() + 1);
+                if(ch == '}')
+                    return true;
+                if(ch != ',')
+                    return fail(PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+                parser.parseWhitespace();
+            }
+        }
+
+        bool array(size_t n){
+            parser.seek(parser.position() + 1);
+            parser.parseWhitespace();
+            if(parser.peek() == ']'){
+                parser.seek(parser.position() + 1);
+                return true;
+            }
+            for(size_t i = 0;; i++){
+                if(!member(child(n, i)))
+                    return false;
+                parser.parseWhitespace();
+                char ch = parser.peek();
+                parser.seek(parser.position() + 1);
+                if(ch == ']')
+                    return true;
+                if(ch != ',')
+                    return fail(PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+            }
+        }
+
+        vector<Node>& nodes;
+        vector<Value>& values;
+        bool lastWins;
+        string_view text;
+        Parser<Walker> parser;
+        Value* current = nullptr;
+        size_t remaining = 0;
+        ParseCode code = PARSE_OK;
+    };
+
+    ParseCode JsonExtractor::extract(string_view text){
+        Walker walker(*this, text);
+        return walker.run();
+    }
+
+    // 惰性解析的校验阶段: 完整检查语法, 按先序记录每个容器的起止位置
+    class LazyIndexer{
+      public:
+        struct Container{
+            size_t begin;
+            size_t end;
+            // 子树之后的第一个容器的序号
+            size_t next;
+        };
+
+        explicit LazyIndexer(vector<Container>& containers) : _containers(containers){}
+
+        void attach(const Parser<LazyIndexer>* parser) { _parser = parser; }
+
+        bool on_null() { return true; }
+        bool on_bool(bool) { return true; }
+        bool on_int64(int64_t) { return true; }
+        bool on_uint64(uint64_t) { return true; }
+        bool on_number(double) { return true; }
+        bool on_string(string_view) { return true; }
+        bool on_key(string_view) { return true; }
+        bool on_start_object() { return start(); }
+        bool on_end_object() { return end(); }
+        bool on_start_array() { return start(); }
+        bool on_end_array() { return end(); }
+
+      private:
+        // 回调时 Parser 已经越过了 '{' / '['
+        bool start(){
+            _open.push_back(_containers.size());
+            _containers.push_back({ _parser->position() - 1, 0, 0 });
+            return true;
+        }
+
+        bool end(){
+            Container& c = _containers[_open.back()];
+            _open.pop_back();
+            c.end = _parser->position();
+            c.next = _containers.size();
+            return true;
+        }
+
+        vector<Container>& _containers;
+        vector<size_t> _open;
+        const Parser<LazyIndexer>* _parser = nullptr;
+    };
+
+    struct LazyDocument : enable_shared_from_this<LazyDocument>{
+        LazyDocument(string_view text, const ParseOptions& options) : text(text), options(options){
+            // 展开发生在 parse 返回之后, 统计只覆盖校验阶段. 不同的线程可能同时展开
+            // 不同的子树, 展开时不使用非线程安全的 arena, resource 和 keyPool
+            this->options.stats = nullptr;
+            this->options.arena = nullptr;
+            this->options.resource = nullptr;
+            this->options.keyPool = nullptr;
+        }
+
+        // 展开第 index 个容器: 标量直接解析, 子容器只记录序号
+        Json materialize(size_t index) const{
+            const LazyIndexer::Container& c = containers[index];
+            const bool object = text[c.begin] == '{';
+            DomBuilder builder(options);
+            Parser<DomBuilder> parser(text, builder);
+            parser.seek(c.begin + 1);
+            object ? builder.on_start_object() : builder.on_start_array();
+            size_t child = index + 1;
+            for(;;){
+                parser.parseWhitespace();
+                char ch = parser.peek();
+                if(ch == '}' || ch == ']')
+                    break;
+                if(ch == ','){
+                    parser.seek(parser.position() + 1);
+                    continue;
+                }
+                if(object){
+                    string_view key;
+                    parser.parseString(key);
+                    builder.on_key(key);
+                    parser.parseWhitespace();
+                    parser.seek(parser.position() + 1);     // ':'
+                    parser.parseWhitespace();
+                    ch = parser.peek();
+                }
+                if(ch == '{' || ch == '['){
+                    builder.on_lazy(shared_from_this(), child);
+                    parser.seek(containers[child].end);
+                    child = containers[child].next;
+                }
+                else
+                    parser.parseValue();
+            }
+            object ? builder.on_end_object() : builder.on_end_array();
+            return builder.result(PARSE_OK);
+        }
+
+        string_view text;
+        ParseOptions options;
+        vector<LazyIndexer::Container> containers;
+        // 持有 text 所在的缓冲区, 例如 parse_file 映射的文件
+        shared_ptr<const void> owner;
+    };
+
+    JsonType LazyValue::type() const{
+        return _doc->text[_doc->containers[_index].begin] == '{' ? JSON_OBJECT : JSON_ARRAY;
+    }
+
+    const Json& LazyValue::value() const{
+        call_once(_once, [this]{ _value = _doc->materialize(_index); });
+        return _value;
+    }
+
+    // 先完整校验, 错误码与立即解析一致; 根节点是标量时直接解析
+    static Json parseLazy(string_view str, const ParseOptions& options, shared_ptr<const void> owner = nullptr){
+        JsonStats* _stats = options.stats;
+        SPARK_JSON_TIMER(parseNanos);
+        shared_ptr<LazyDocument> doc = make_shared<LazyDocument>(str, options);
+        doc->owner = move(owner);
+        LazyIndexer indexer(doc->containers);
+        Parser<LazyIndexer> validator(str, indexer);
+        indexer.attach(&validator);
+        ParseCode code = validator.parse();
+        if(code != PARSE_OK){
+            // 校验失败时直接返回错误码, 结果与 DomBuilder::result 相同, 不再完整解析一遍
+            Json json = code == PARSE_NUMBER_TOO_BIG && doc->containers.empty() ? Json(0) : Json();
+            json.setErrorCode(code);
+            return json;
+        }
+        DomBuilder builder(options);
+        if(doc->containers.empty()){
+            Parser<DomBuilder> parser(str, builder);
+            return builder.result(parser.parse());
+        }
+        builder.on_lazy(move(doc), 0);
+        return builder.result(PARSE_OK);
+    }
+
+    // 增量解析的状态机. 结构字符逐个推进; 字符串/数字/字面量先确定边界,
+    // 再交给 Parser 转换, 因此错误码与 Json::parse 完全一致
+    template<typename Handler>
+    class StreamMachine{
+      public:
+        explicit StreamMachine(Handler& handler) : _handler(handler){}
+
+        ParseCode feed(const char* data, size_t len){
+            const char* p = data;
+            const char* end = data + len;
+            while(p < end && _code == PARSE_OK)
+                p = step(p, end);
+            return _code;
+        }
+
+        // 输入结束, 返回最终的解析结果
+        ParseCode finish(){
+            if(_code != PARSE_OK)
+                return _code;
+            switch(_state){
+                case S_STRING:
+                case S_KEY:
+                    // 未闭合的字符串交给 Parser 报告具体错误
+                    finishString(_token);
+                    return _code == PARSE_OK ? PARSE_MISS_QUOTATION_MARK : _code;
+                case S_NUMBER:
+                    if(!numberComplete())
+                        return _code = PARSE_INVALID_VALUE;
+                    if(!finishNumber())
+                        return _code;
+                    break;
+                case S_LITERAL:
+                    return _code = PARSE_INVALID_VALUE;
+                default:
+                    break;
+            }
+            switch(_state){
+                case S_VALUE:
+                case S_ARRAY_FIRST:  return _code = PARSE_EXPECT_VALUE;
+                case S_ARRAY_NEXT:   return _code = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                case S_OBJECT_FIRST:
+                case S_OBJECT_KEY:   return _code = PARSE_MISS_KEY;
+                case S_OBJECT_COLON: return _code = PARSE_MISS_COLON;
+                case S_OBJECT_NEXT:  return _code = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                default:             return _code;
+            }
+        }
+
+      private:
+        enum State{
+            S_VALUE,
+            S_ARRAY_FIRST,
+            S_ARRAY_NEXT,
+            S_OBJECT_FIRST,
+            S_OBJECT_KEY,
+            S_OBJECT_COLON,
+            S_OBJECT_NEXT,
+            S_DONE,
+            S_STRING,
+            S_KEY,
+            S_NUMBER,
+            S_LITERAL
+        };
+
+        enum NumberState{
+            N_MINUS,
+            N_ZERO,
+            N_INT,
+            N_DOT,
+            N_FRAC,
+            N_E,
+            N_EXP_SIGN,
+            N_EXP
+        };
+
+        static bool isWhitespace(char ch){
+            return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+        }
+
+        static bool isDigit(char ch){
+            return ch >= '0' && ch <= '9';
+        }
+
+        bool emit(bool ok){
+            if(!ok)
+                _code = PARSE_CANCELLED;
+            return ok;
+        }
+
+        void afterValue(){
+            if(_containers.empty())
+                _state = S_DONE;
+            else
+                _state = _containers.back() == '[' ? S_ARRAY_NEXT : S_OBJECT_NEXT;
+        }
+
+        void endContainer(){
+            bool object = _containers.back() == '{';
+            _containers.pop_back();
+            if(emit(object ? _handler.on_end_object() : _handler.on_end_array()))
+                afterValue();
+        }
+
+        const char* step(const char* p, const char* end){
+            switch(_state){
+                case S_STRING:
+                case S_KEY:     return scanString(p, end);
+                case S_NUMBER:  return scanNumber(p, end);
+                case S_LITERAL: return scanLiteral(p, end);
+                default:        break;
+            }
+
+            char ch = *p;
+            if(isWhitespace(ch))
+                return p + 1;
+
+            switch(_state){
+                case S_VALUE:
+                    return startValue(p, end);
+                case S_ARRAY_FIRST:
+                    if(ch == ']'){
+                        endContainer();
+                        return p + 1;
+                    }
+                    return startValue(p, end);
+                case S_ARRAY_NEXT:
+                    if(ch == ',')
+                        _state = S_VALUE;
+                    else if(ch == ']')
+                        endContainer();
+                    else
+                        _code = PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    return p + 1;
+                case S_OBJECT_FIRST:
+                    if(ch == '}'){
+                        endContainer();
+                        return p + 1;
+                    }
+                    // fall through
+                case S_OBJECT_KEY:
+                    if(ch != '\"'){
+                        _code = PARSE_MISS_KEY;
+                        return p + 1;
+                    }
+                    return startString(S_KEY, p, end);
+                case S_OBJECT_COLON:
+                    if(ch == ':')
+                        _state = S_VALUE;
+                    else
+                        _code = PARSE_MISS_COLON;
+                    return p + 1;
+                case S_OBJECT_NEXT:
+                    if(ch == ',')
+                        _state = S_OBJECT_KEY;
+                    else if(ch == '}')
+                        endContainer();
+                    else
+                        _code = PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    return p + 1;
+                default:
+                    _code = PARSE_ROOT_NOT_SINGULAR;
+                    return p + 1;
+            }
+        }
+
+        const char* startValue(const char* p, const char* end){
+            char ch = *p;
+            switch(ch){
+                case 'n': _literal = "null"; break;
+                case 't': _literal = "true"; break;
+                case 'f': _literal = "false"; break;
+                case '"': return startString(S_STRING, p, end);
+                case '{':
+                    if(emit(_handler.on_start_object())){
+                        _containers.push_back('{');
+                        _state = S_OBJECT_FIRST;
+                    }
+                    return p + 1;
+                case '[':
+                    if(emit(_handler.on_start_array())){
+                        _containers.push_back('[');
+                        _state = S_ARRAY_FIRST;
+                    }
+                    return p + 1;
+                default:
+                    if(ch == '-')
+                        _number = N_MINUS;
+                    else if(ch == '0')
+                        _number = N_ZERO;
+                    else if(isDigit(ch))
+                        _number = N_INT;
+                    else{
+                        _code = PARSE_INVALID_VALUE;
+                        return p + 1;
+                    }
+                    _token.assign(1, ch);
+                    _state = S_NUMBER;
+                    return p + 1;
+            }
+            _literalPos = 1;
+            _state = S_LITERAL;
+            return p + 1;
+        }
+
+        const char* scanLiteral(const char* p, const char* end){
+            for(; p < end && _literalPos < _literal.length(); p++, _literalPos++){
+                if(*p != _literal[_literalPos]){
+                    _code = PARSE_INVALID_VALUE;
+                    return p + 1;
+                }
+            }
+            if(_literalPos == _literal.length()){
+                bool ok = _literal[0] == 'n' ? _handler.on_null() : _handler.on_bool(_literal[0] == 't');
+                if(emit(ok))
+                    afterValue();
+            }
+            return p;
+        }
+
+        bool numberComplete() const{
+            return _number == N_ZERO || _number == N_INT || _number == N_FRAC || _number == N_EXP;
+        }
+
+        bool finishNumber(){
+            Parser<Handler> parser(_token, _handler);
+            if(!parser.parseNumber()){
+                _code = parser.getCode();
+                return false;
+            }
+            afterValue();
+            return true;
+        }
+
+        // 数字跨分片时按 parseNumber 的语法逐字符推进, 遇到结束字符时不消耗它
+        const char* scanNumber(const char* p, const char* end){
+            for(; p < end; p++){
+                char ch = *p;
+                bool digit = isDigit(ch);
+                switch(_number){
+                    case N_MINUS:
+                        if(!digit){
+                            _code = PARSE_INVALID_VALUE;
+                            return p;
+                        }
+                        _number = ch == '0' ? N_ZERO : N_INT;
+                        break;
+                    case N_ZERO:
+                    case N_INT:
+                    case N_FRAC:
+                        if(digit && _number == N_ZERO){
+                            _code = PARSE_INVALID_VALUE;
+                            return p;
+                        }
+                        if(digit)
+                            break;
+                        if(ch == '.' && _number != N_FRAC)
+                            _number = N_DOT;
+                        else if(ch == 'e' || ch == 'E')
+                            _number = N_E;
+                        else{
+                            finishNumber();
+                            return p;
+                        }
+                        break;
+                    case N_DOT:
+                        if(!digit){
+                            _code = PARSE_INVALID_VALUE;
+                            return p;
+                        }
+                        _number = N_FRAC;
+                        break;
+                    case N_E:
+                        if(ch == '+' || ch == '-'){
+                            _number = N_EXP_SIGN;
+                            break;
+                        }
+                        // fall through
+                    case N_EXP_SIGN:
+                        if(!digit){
+                            _code = PARSE_INVALID_VALUE;
+                            return p;
+                        }
+                        _number = N_EXP;
+                        break;
+                    case N_EXP:
+                        if(!digit){
+                            finishNumber();
+                            return p;
+                        }
+                        break;
+                }
+                _token += ch;
+            }
+            return p;
+        }
+
+        const char* startString(State state, const char* p, const char* end){
+            _state = state;
+            _token.clear();
+            _escape = false;
+            return scanString(p, p + 1, end);
+        }
+
+        const char* scanString(const char* p, const char* end){
+            return scanString(nullptr, p, end);
+        }
+
+        // start 非空表示字符串从本分片开始, 在分片内结束时直接解析, 不经过 _token
+        const char* scanString(const char* start, const char* p, const char* end){
+            const char* q = p;
+            if(_escape && q < end){
+                _escape = false;
+                q++;
+            }
+            for(;;){
+                q = findSpecialChar(q, end, '\"');
+                if(q == end)
+                    break;
+                if(*q == '\\'){
+                    if(q + 1 == end){
+                        _escape = true;
+                        q = end;
+                        break;
+                    }
+                    q += 2;
+                }
+                else if(*q == '\"'){
+                    q++;
+                    if(start)
+                        finishString(string_view(start, q - start));
+                    else{
+                        _token.append(p, q - p);
+                        finishString(_token);
+                    }
+                    return q;
+                }
+                else
+                    q++;
+            }
+            _token.append(start ? start : p, end - (start ? start : p));
+            return end;
+        }
+
+        void finishString(string_view text){
+            Parser<Handler> parser(text, _handler);
+            string_view s;
+            if(!parser.parseString(s)){
+                _code = parser.getCode();
+                return;
+            }
+            if(_state == S_KEY){
+                if(emit(_handler.on_key(s)))
+                    _state = S_OBJECT_COLON;
+            }
+            else if(emit(_handler.on_string(s)))
+                afterValue();
+        }
+
+        Handler& _handler;
+        State _state = S_VALUE;
+        ParseCode _code = PARSE_OK;
+        vector<char> _containers;
+        string _token;
+        string_view _literal;
+        size_t _literalPos = 0;
+        NumberState _number = N_INT;
+        bool _escape = false;
+    };
+
+    struct StreamParser::Impl{
+        explicit Impl(const ParseOptions& options) : options(options), builder(options), machine(builder){}
+
+        ParseOptions options;
+        DomBuilder builder;
+        StreamMachine<DomBuilder> machine;
+    };
+
+    StreamParser::StreamParser(const ParseOptions& options) : _impl(new Impl(options)){}
+
+    StreamParser::~StreamParser(){}
+
+    ParseCode StreamParser::feed(const char* data, size_t len){
+        return _impl->machine.feed(data, len);
+    }
+
+    Json StreamParser::finish(){
+        Json json = _impl->builder.result(_impl->machine.finish());
+        _impl.reset(new Impl(_impl->options));
+        return json;
+    }
+
+    // msgpack
+
+    template<typename T>
+    static void appendBigEndian(string& out, uint8_t tag, T value){
+        char buf[1 + sizeof(T)];
+        buf[0] = static_cast<char>(tag);
+        for(size_t i = 0; i < sizeof(T); i++)
+            buf[sizeof(T) - i] = static_cast<char>(static_cast<uint64_t>(value) >> (i * 8));
+        out.append(buf, sizeof buf);
+    }
+
+    // 长度前缀: fix 格式放不下时依次尝试 8/16/32 位, tag8 为 0 表示没有 8 位格式
+    static void appendMsgpackLength(string& out, size_t n, uint8_t fixTag, size_t fixLimit, uint8_t tag8, uint8_t tag16){
+        if(n < fixLimit)
+            out += static_cast<char>(fixTag | n);
+        else if(tag8 && n <= 0xFF)
+            appendBigEndian(out, tag8, static_cast<uint8_t>(n));
+        else if(n <= 0xFFFF)
+            appendBigEndian(out, tag16, static_cast<uint16_t>(n));
+        else
+            appendBigEndian(out, tag16 + 1, static_cast<uint32_t>(n));
+    }
+
+    static void appendMsgpackString(string& out, string_view str){
+        appendMsgpackLength(out, str.size(), 0xa0, 32, 0xd9, 0xda);
+        out.append(str.data(), str.size());
+    }
+
+    void Json::dump_msgpack(string& out) const{
+        switch(_kind){
+            case KIND_NULL:
+                out += static_cast<char>(0xc0);
+                return;
+            case KIND_BOOL:
+                out += static_cast<char>(_bool ? 0xc3 : 0xc2);
+                return;
+            case KIND_INT:
+                // int 使用最短的有符号格式, 解码时都还原为 int
+                if(_int >= -32 && _int <= 127)
+                    out += static_cast<char>(_int);
+                else if(_int >= INT8_MIN && _int <= INT8_MAX)
+                    appendBigEndian(out, 0xd0, static_cast<int8_t>(_int));
+                else if(_int >= INT16_MIN && _int <= INT16_MAX)
+                    appendBigEndian(out, 0xd1, static_cast<int16_t>(_int));
+                else
+                    appendBigEndian(out, 0xd2, static_cast<int32_t>(_int));
+                return;
+            case KIND_INT64:
+                appendBigEndian(out, 0xd3, _int64);
+                return;
+            case KIND_UINT64:
+                appendBigEndian(out, 0xcf, _uint64);
+                return;
+            case KIND_DOUBLE:{
+                uint64_t bits;
+                memcpy(&bits, &_double, sizeof bits);
+                appendBigEndian(out, 0xcb, bits);
+                return;
+            }
+            case KIND_VALUE:
+                break;
+        }
+        switch(type()){
+            case JSON_STRING:
+                appendMsgpackString(out, to_string_view());
+                break;
+            case JSON_ARRAY:
+                appendMsgpackLength(out, size(), 0x90, 16, 0, 0xdc);
+                for(const Json& value : to_array())
+                    value.dump_msgpack(out);
+                break;
+            case JSON_OBJECT:
+                appendMsgpackLength(out, size(), 0x80, 16, 0, 0xde);
+                for(const auto& kv : to_object()){
+                    appendMsgpackString(out, kv.first.view());
+                    kv.second.dump_msgpack(out);
+                }
+                break;
+            default:
+                out += static_cast<char>(0xc0);
+                break;
+        }
+    }
+
+    // 非递归地解码 MessagePack, 以与文本解析相同的事件驱动 DomBuilder
+    class MsgpackReader{
+      public:
+        MsgpackReader(string_view data, DomBuilder& builder) : _data(data), _builder(builder){}
+
+        ParseCode parse(){
+            if(_data.empty())
+                return PARSE_EXPECT_VALUE;
+            if(!parseValue())
+                return _code;
+            while(!_frames.empty()){
+                Frame& frame = _frames.back();
+                if(frame.remaining == 0){
+                    bool object = frame.object;
+                    _frames.pop_back();
+                    if(!emit(object ? _builder.on_end_object() : _builder.on_end_array()))
+                        return _code;
+                    continue;
+                }
+                frame.remaining--;
+                if(frame.object && !parseKey())
+                    return _code;
+                if(!parseValue())
+                    return _code;
+            }
+            return _pos == _data.size() ? PARSE_OK : PARSE_ROOT_NOT_SINGULAR;
+        }
+
+      private:
+        // 容器中还没有读取的元素个数, 对象按键值对计
+        struct Frame{
+            size_t remaining;
+            bool object;
+        };
+
+        bool fail(ParseCode code){
+            _code = code;
+            return false;
+        }
+
+        template<typename T>
+        bool read(T& value){
+            if(_data.size() - _pos < sizeof(T))
+                return fail(PARSE_INVALID_MSGPACK);
+            uint64_t bits = 0;
+            for(size_t i = 0; i < sizeof(T); i++)
+                bits = (bits << 8) | static_cast<uint8_t>(_data[_pos++]);
+            value = static_cast<T>(bits);
+            return true;
+        }
+
+        template<typename T>
+        bool readLength(size_t& n){
+            T len;
+            if(!read(len))
+                return false;
+            n = len;
+            return true;
+        }
+
+        bool readString(size_t n, string_view& out){
+            if(_data.size() - _pos < n)
+                return fail(PARSE_INVALID_MSGPACK);
+            out = _data.substr(_pos, n);
+            _pos += n;
+            return true;
+        }
+
+        // 读取 str 族的长度, 不是字符串时返回 false 且不移动位置
+        bool stringLength(uint8_t tag, size_t& n){
+            if((tag & 0xe0) == 0xa0){
+                n = tag & 0x1f;
+                return true;
+            }
+            switch(tag){
+                case 0xd9: return readLength<uint8_t>(n);
+                case 0xda: return readLength<uint16_t>(n);
+                case 0xdb: return readLength<uint32_t>(n);
+                default:   return false;
+            }
+        }
+
+        bool parseKey(){
+            if(_pos >= _data.size())
+                return fail(PARSE_INVALID_MSGPACK);
+            uint8_t tag = static_cast<uint8_t>(_data[_pos++]);
+            size_t n;
+            string_view key;
+            if(!stringLength(tag, n))
+                return fail(_code == PARSE_OK ? PARSE_MISS_KEY : _code);
+            if(!readString(n, key))
+                return false;
+            return emit(_builder.on_key(key));
+        }
+
+        bool parseValue(){
+            if(_pos >= _data.size())
+                return fail(PARSE_INVALID_MSGPACK);
+            uint8_t tag = static_cast<uint8_t>(_data[_pos++]);
+            if(tag <= 0x7f)
+                return emit(_builder.on_int(tag));
+            if(tag >= 0xe0)
+                return emit(_builder.on_int(static_cast<int8_t>(tag)));
+            if((tag & 0xf0) == 0x80)
+                return startContainer(tag & 0x0f, true);
+            if((tag & 0xf0) == 0x90)
+                return startContainer(tag & 0x0f, false);
+            size_t n;
+            if(stringLength(tag, n)){
+                string_view str;
+                return readString(n, str) && emit(_builder.on_string(str));
+            }
+            if(_code != PARSE_OK)
+                return false;
+            switch(tag){
+                case 0xc0: return emit(_builder.on_null());
+                case 0xc2: return emit(_builder.on_bool(false));
+                case 0xc3: return emit(_builder.on_bool(true));
+                case 0xcc: { uint8_t v;  return read(v) && emit(_builder.on_int(v)); }
+                case 0xcd: { uint16_t v; return read(v) && emit(_builder.on_int(v)); }
+                case 0xce:{
+                    uint32_t v;
+                    if(!read(v))
+                        return false;
+                    return emit(v <= INT32_MAX ? _builder.on_int(static_cast<int>(v)) : _builder.on_int64(v));
+                }
+                case 0xcf: { uint64_t v; return read(v) && emit(_builder.on_uint64(v)); }
+                case 0xd0: { int8_t v;   return read(v) && emit(_builder.on_int(v)); }
+                case 0xd1: { int16_t v;  return read(v) && emit(_builder.on_int(v)); }
+                case 0xd2: { int32_t v;  return read(v) && emit(_builder.on_int(v)); }
+                case 0xd3: { int64_t v;  return read(v) && emit(_builder.on_int64(v)); }
+                case 0xca:{
+                    uint32_t bits;
+                    float v;
+                    if(!read(bits))
+                        return false;
+                    memcpy(&v, &bits, sizeof v);
+                    return emit(_builder.on_number(v));
+                }
+                case 0xcb:{
+                    uint64_t bits;
+                    double v;
+                    if(!read(bits))
+                        return false;
+                    memcpy(&v, &bits, sizeof v);
+                    return emit(_builder.on_number(v));
+                }
+                case 0xdc: return readLength<uint16_t>(n) && startContainer(n, false);
+                case 0xdd: return readLength<uint32_t>(n) && startContainer(n, false);
+                case 0xde: return readLength<uint16_t>(n) && startContainer(n, true);
+                case 0xdf: return readLength<uint32_t>(n) && startContainer(n, true);
+                // bin/ext 以及保留的 0xc1 没有对应的 JsonType
+                default:   return fail(PARSE_INVALID_MSGPACK);
+            }
+        }
+
+        bool startContainer(size_t n, bool object){
+            // 每个元素至少一个字节, 长度超过剩余输入时直接报错, 不按长度预留
+            if(n > _data.size() - _pos)
+                return fail(PARSE_INVALID_MSGPACK);
+            if(!emit(object ? _builder.on_start_object() : _builder.on_start_array()))
+                return false;
+            _frames.push_back(Frame{ n, object });
+            return true;
+        }
+
+        bool emit(bool ok){
+            return ok || fail(PARSE_CANCELLED);
+        }
+
+        string_view _data;
+        size_t _pos = 0;
+        ParseCode _code = PARSE_OK;
+        DomBuilder& _builder;
+        vector<Frame> _frames;
+    };
+
+    Json Json::parse_msgpack(string_view data, const ParseOptions& options){
+        DomBuilder builder(options);
+        MsgpackReader reader(data, builder);
+        return builder.result(reader.parse());
+    }
+
+    // tape
+
+    // 魔数和版本之后是根节点. 每个节点以一个字节的 TapeTag 开头, 数字按小端存放:
+    //   int 4 字节, int64/uint64/double 8 字节, 字符串为 u32 长度和内容;
+    //   容器为 u32 长度 (其后到容器结尾的字节数), u32 元素个数, 每个元素一个 u32 偏移
+    //   (相对容器开头), 然后是各个元素. 对象的元素为 u32 键长度, 键和值
+    static const char kTapeMagic[4] = { 'S', 'J', 'T', 1 };
+    static const size_t kTapeHeader = sizeof kTapeMagic;
+    static const size_t kTapeContainerHeader = 1 + 4 + 4;
+
+    enum TapeTag : uint8_t{
+        TAPE_NULL = 0,
+        TAPE_FALSE,
+        TAPE_TRUE,
+        TAPE_INT,
+        TAPE_INT64,
+        TAPE_UINT64,
+        TAPE_DOUBLE,
+        TAPE_STRING,
+        TAPE_ARRAY,
+        TAPE_OBJECT,            // 保持插入顺序, 按键查找为线性
+        TAPE_SORTED_OBJECT      // 按键排序, 按键查找为二分
+    };
+
+    template<typename T>
+    static void appendLittleEndian(string& out, T value){
+        char buf[sizeof(T)];
+        for(size_t i = 0; i < sizeof(T); i++)
+            buf[i] = static_cast<char>(static_cast<uint64_t>(value) >> (i * 8));
+        out.append(buf, sizeof buf);
+    }
+
+    static void storeU32(string& out, size_t pos, size_t value){
+        for(size_t i = 0; i < 4; i++)
+            out[pos + i] = static_cast<char>(value >> (i * 8));
+    }
+
+    void Json::dumpTape(string& out) const{
+        switch(_kind){
+            case KIND_NULL:
+                out += static_cast<char>(TAPE_NULL);
+                return;
+            case KIND_BOOL:
+                out += static_cast<char>(_bool ? TAPE_TRUE : TAPE_FALSE);
+                return;
+            case KIND_INT:
+                out += static_cast<char>(TAPE_INT);
+                appendLittleEndian(out, static_cast<int32_t>(_int));
+                return;
+            case KIND_INT64:
+                out += static_cast<char>(TAPE_INT64);
+                appendLittleEndian(out, _int64);
+                return;
+            case KIND_UINT64:
+                out += static_cast<char>(TAPE_UINT64);
+                appendLittleEndian(out, _uint64);
+                return;
+            case KIND_DOUBLE:{
+                uint64_t bits;
+                memcpy(&bits, &_double, sizeof bits);
+                out += static_cast<char>(TAPE_DOUBLE);
+                appendLittleEndian(out, bits);
+                return;
+            }
+            case KIND_VALUE:
+                break;
+        }
+        const JsonType jsonType = type();
+        if(jsonType == JSON_STRING){
+            string_view str = to_string_view();
+            out += static_cast<char>(TAPE_STRING);
+            appendLittleEndian(out, static_cast<uint32_t>(str.size()));
+            out += str;
+            return;
+        }
+        if(jsonType != JSON_ARRAY && jsonType != JSON_OBJECT){
+            out += static_cast<char>(TAPE_NULL);
+            return;
+        }
+
+        // 先留出头部和偏移表, 写完元素后回填
+        const size_t start = out.size();
+        const size_t count = size();
+        if(jsonType == JSON_ARRAY)
+            out += static_cast<char>(TAPE_ARRAY);
+        else
+            out += static_cast<char>(to_object().preserveOrder() ? TAPE_OBJECT : TAPE_SORTED_OBJECT);
+        out.resize(start + kTapeContainerHeader + count * 4);
+        storeU32(out, start + 5, count);
+        size_t slot = start + kTapeContainerHeader;
+        if(jsonType == JSON_ARRAY){
+            for(const Json& value : to_array()){
+                storeU32(out, slot, out.size() - start);
+                slot += 4;
+                value.dumpTape(out);
+            }
+        }
+        else{
+            for(const auto& kv : to_object()){
+                storeU32(out, slot, out.size() - start);
+                slot += 4;
+                appendLittleEndian(out, static_cast<uint32_t>(kv.first.size()));
+                out.append(kv.first.data(), kv.first.size());
+                kv.second.dumpTape(out);
+            }
+        }
+        storeU32(out, start + 1, out.size() - start - 5);
+    }
+
+    bool Json::dump_tape(string& out) const{
+        const size_t start = out.size();
+        out.append(kTapeMagic, kTapeHeader);
+        dumpTape(out);
+        // 偏移和长度都是 u32, 整个 tape 不超过 4 GB 时内部的值都不会截断
+        if(out.size() - start > UINT32_MAX){
+            out.resize(start);
+            return false;
+        }
+        return true;
+    }
+
+    JsonTapeView::JsonTapeView(string_view tape){
+        if(tape.size() > kTapeHeader && memcmp(tape.data(), kTapeMagic, kTapeHeader) == 0){
+            _data = tape.data();
+            _size = tape.size();
+            _pos = kTapeHeader;
+        }
+    }
+
+    uint8_t JsonTapeView::tag() const{
+        return _data && _pos < _size ? static_cast<uint8_t>(_data[_pos]) : static_cast<uint8_t>(TAPE_NULL);
+    }
+
+    template<typename T>
+    T JsonTapeView::read(size_t pos) const{
+        if(pos > _size || _size - pos < sizeof(T))
+            return 0;
+        uint64_t bits = 0;
+        for(size_t i = 0; i < sizeof(T); i++)
+            bits |= static_cast<uint64_t>(static_cast<uint8_t>(_data[pos + i])) << (i * 8);
+        return static_cast<T>(bits);
+    }
+
+    JsonType JsonTapeView::type() const{
+        switch(tag()){
+            case TAPE_FALSE:
+            case TAPE_TRUE:          return JSON_BOOL;
+            case TAPE_INT:
+            case TAPE_INT64:
+            case TAPE_UINT64:
+            case TAPE_DOUBLE:        return JSON_NUMBER;
+            case TAPE_STRING:        return JSON_STRING;
+            case TAPE_ARRAY:         return JSON_ARRAY;
+            case TAPE_OBJECT:
+            case TAPE_SORTED_OBJECT: return JSON_OBJECT;
+            default:                 return JSON_NULL;
+        }
+    }
+
+    size_t JsonTapeView::size() const{
+        const uint8_t t = tag();
+        if(t != TAPE_ARRAY && t != TAPE_OBJECT && t != TAPE_SORTED_OBJECT)
+            return 1;
+        // 容器超出缓冲区或偏移表放不进容器时视为损坏
+        size_t length = read<uint32_t>(_pos + 1);
+        size_t count = read<uint32_t>(_pos + 5);
+        if(_size - _pos < 5 || _size - _pos - 5 < length || length < 4)
+            return 0;
+        return count <= (length - 4) / 4 ? count : 0;
+    }
+
+    size_t JsonTapeView::element(size_t i) const{
+        const uint8_t t = tag();
+        if((t != TAPE_ARRAY && t != TAPE_OBJECT && t != TAPE_SORTED_OBJECT) || i >= size())
+            return 0;
+        // 偏移必须落在容器内且位于头部之后, 沿着偏移访问时位置只会前进
+        size_t offset = read<uint32_t>(_pos + kTapeContainerHeader + i * 4);
+        size_t length = read<uint32_t>(_pos + 1);
+        if(offset < kTapeContainerHeader || offset >= 5 + length)
+            return 0;
+        return _pos + offset;
+    }
+
+    JsonTapeView JsonTapeView::entryValue(size_t entry) const{
+        if(entry == 0)
+            return JsonTapeView();
+        return JsonTapeView(_data, _size, entry + 4 + read<uint32_t>(entry));
+    }
+
+    bool JsonTapeView::to_bool() const{
+        return tag() == TAPE_TRUE;
+    }
+
+    template<typename T>
+    T JsonTapeView::numberAs() const{
+        switch(tag()){
+            case TAPE_INT:    return static_cast<T>(read<int32_t>(_pos + 1));
+            case TAPE_INT64:  return static_cast<T>(read<int64_t>(_pos + 1));
+            case TAPE_UINT64: return static_cast<T>(read<uint64_t>(_pos + 1));
+            case TAPE_DOUBLE:{
+                uint64_t bits = read<uint64_t>(_pos + 1);
+                double value;
+                memcpy(&value, &bits, sizeof value);
+                return fromDouble<T>(value);
+            }
+            default:          return 0;
+        }
+    }
+
+    int JsonTapeView::to_int() const { return numberAs<int>(); }
+    int64_t JsonTapeView::to_int64_t() const { return numberAs<int64_t>(); }
+    uint64_t JsonTapeView::to_uint64_t() const { return numberAs<uint64_t>(); }
+    double JsonTapeView::to_double() const { return numberAs<double>(); }
+
+    string_view JsonTapeView::to_string() const{
+        if(tag() != TAPE_STRING)
+            return string_view();
+        size_t len = read<uint32_t>(_pos + 1);
+        if(_size - _pos < 5 || _size - _pos - 5 < len)
+            return string_view();
+        return string_view(_data + _pos + 5, len);
+    }
+
+    JsonTapeView JsonTapeView::operator[](size_t i) const{
+        size_t pos = tag() == TAPE_ARRAY ? element(i) : 0;
+        return pos ? JsonTapeView(_data, _size, pos) : JsonTapeView();
+    }
+
+    string_view JsonTapeView::key(size_t i) const{
+        const uint8_t t = tag();
+        size_t entry = t == TAPE_OBJECT || t == TAPE_SORTED_OBJECT ? element(i) : 0;
+        if(entry == 0)
+            return string_view();
+        size_t len = read<uint32_t>(entry);
+        if(_size - entry < 4 || _size - entry - 4 < len)
+            return string_view();
+        return string_view(_data + entry + 4, len);
+    }
+
+    JsonTapeView JsonTapeView::operator[](string_view name) const{
+        const uint8_t t = tag();
+        if(t == TAPE_SORTED_OBJECT){
+            size_t lo = 0, hi = size();
+            while(lo < hi){
+                size_t mid = lo + (hi - lo) / 2;
+                int c = key(mid).compare(name);
+                if(c == 0)
+                    return entryValue(element(mid));
+                if(c < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+        }
+        else if(t == TAPE_OBJECT){
+            for(size_t i = 0, n = size(); i < n; i++)
+                if(key(i) == name)
+                    return entryValue(element(i));
+        }
+        return JsonTapeView();
+    }
+
+    JsonTapeView JsonTapeView::at(const JsonPointer& pointer) const{
+        if(!pointer._valid)
+            return JsonTapeView();
+        JsonTapeView node = *this;
+        for(const JsonPointer::Token& token : pointer._tokens){
+            switch(node.type()){
+                case JSON_OBJECT: node = node[token.key.view()]; break;
+                case JSON_ARRAY:  node = node[token.index]; break;
+                default:          return JsonTapeView();
+            }
+            if(!node.valid())
+                break;
+        }
+        return node;
+    }
+
+    Json JsonTapeView::to_json() const{
+        switch(tag()){
+            case TAPE_FALSE:  return Json(false);
+            case TAPE_TRUE:   return Json(true);
+            case TAPE_INT:    return Json(to_int());
+            case TAPE_INT64:  return Json(to_int64_t());
+            case TAPE_UINT64: return Json(to_uint64_t());
+            case TAPE_DOUBLE: return Json(to_double());
+            case TAPE_STRING: return Json(string(to_string()));
+            case TAPE_ARRAY:{
+                const size_t n = size();
+                Json::array values;
+                values.reserve(n);
+                for(size_t i = 0; i < n; i++)
+                    values.push_back((*this)[i].to_json());
+                return Json(move(values));
+            }
+            case TAPE_OBJECT:
+            case TAPE_SORTED_OBJECT:{
+                const size_t n = size();
+                Json::object::container_type entries;
+                entries.reserve(n);
+                for(size_t i = 0; i < n; i++)
+                    entries.emplace_back(JsonKey(key(i)), entryValue(element(i)).to_json());
+                return Json(Json::object(move(entries), tag() == TAPE_OBJECT));
+            }
+            default:
+                return Json();
+        }
+    }
+
+    // ndjson
+
+    struct NdjsonChunk{
+        string_view text;
+        size_t firstLine;
+        vector<pair<size_t, Json>> docs;
+    };
+
+    // 在 chunkSize 之后的第一个换行处切块, 同时统计每块的起始行号
+    static vector<NdjsonChunk> splitChunks(string_view text, size_t chunkSize){
+        vector<NdjsonChunk> chunks;
+        chunkSize = max<size_t>(chunkSize, 1);
+        size_t line = 0;
+        for(size_t pos = 0; pos < text.size();){
+            size_t end = text.size();
+            if(text.size() - pos > chunkSize){
+                size_t from = pos + chunkSize - 1;
+                const void* nl = memchr(text.data() + from, '\n', text.size() - from);
+                if(nl)
+                    end = static_cast<const char*>(nl) - text.data() + 1;
+            }
+            chunks.push_back(NdjsonChunk{ text.substr(pos, end - pos), line, {} });
+            line += count(text.data() + pos, text.data() + end, '\n');
+            pos = end;
+        }
+        return chunks;
+    }
+
+    // 对块中每个非空白行调用 f(line, text)
+    template<typename F>
+    static void forEachLine(const NdjsonChunk& chunk, F f){
+        const char* p = chunk.text.data();
+        const char* end = p + chunk.text.size();
+        for(size_t line = chunk.firstLine; p < end; line++){
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            string_view text(p, (nl ? nl : end) - p);
+            if(text.find_first_not_of(" \t\r") != string_view::npos && !f(line, text))
+                return;
+            if(!nl)
+                break;
+            p = nl + 1;
+        }
+    }
+
+    // 工作线程按序号领取块; 交付线程按序号或按完成顺序取回.
+    // 领取但尚未交付的块不超过 window 个
+    class ChunkScheduler{
+      public:
+        ChunkScheduler(size_t count, size_t window) : _count(count), _window(window), _finished(count, 0){}
+
+        bool claim(size_t& index){
+            unique_lock<mutex> lock(_mutex);
+            _cv.wait(lock, [this]{ return _stop || _next == _count || _next - _delivered < _window; });
+            if(_stop || _next == _count)
+                return false;
+            index = _next++;
+            return true;
+        }
+
+        void complete(size_t index){
+            lock_guard<mutex> lock(_mutex);
+            _finished[index] = 1;
+            _ready.push_back(index);
+            _cv.notify_all();
+        }
+
+        size_t next(bool ordered){
+            unique_lock<mutex> lock(_mutex);
+            if(ordered){
+                size_t index = _delivered;
+                _cv.wait(lock, [&]{ return _finished[index] != 0; });
+                return index;
+            }
+            _cv.wait(lock, [this]{ return !_ready.empty(); });
+            size_t index = _ready.front();
+            _ready.pop_front();
+            return index;
+        }
+
+        void delivered(){
+            lock_guard<mutex> lock(_mutex);
+            _delivered++;
+            _cv.notify_all();
+        }
+
+        void stop(){
+            lock_guard<mutex> lock(_mutex);
+            _stop = true;
+            _cv.notify_all();
+        }
+
+      private:
+        mutex _mutex;
+        condition_variable _cv;
+        size_t _count;
+        size_t _window;
+        size_t _next = 0;
+        size_t _delivered = 0;
+        bool _stop = false;
+        vector<char> _finished;
+        deque<size_t> _ready;
+    };
+
+    NdjsonReader::NdjsonReader(const NdjsonOptions& options) : _options(options){
+        _options.parse.arena = nullptr;
+        _options.parse.keyPool = nullptr;
+        _options.parse.resource = nullptr;
+        _options.parse.stats = nullptr;
+        if(_options.threads == 0)
+            _options.threads = max(1u, thread::hardware_concurrency());
+    }
+
+    ParseCode NdjsonReader::parse(string_view text, const Callback& callback){
+        if(!callback)
+            return PARSE_INVALID_ARGUMENT;
+        vector<NdjsonChunk> chunks = splitChunks(text, _options.chunkSize);
+        size_t threads = min(_options.threads, chunks.size());
+        ChunkScheduler scheduler(chunks.size(), threads * 4);
+        vector<thread> workers;
+        for(size_t t = 0; t < threads; t++){
+            workers.emplace_back([&]{
+                size_t index;
+                while(scheduler.claim(index)){
+                    NdjsonChunk& chunk = chunks[index];
+                    forEachLine(chunk, [&](size_t line, string_view s){
+                        chunk.docs.emplace_back(line, Json::parse(s, _options.parse));
+                        return true;
+                    });
+                    scheduler.complete(index);
+                }
+            });
+        }
+
+        ParseCode code = PARSE_OK;
+        for(size_t k = 0; k < chunks.size() && code == PARSE_OK; k++){
+            NdjsonChunk& chunk = chunks[scheduler.next(_options.ordered)];
+            for(pair<size_t, Json>& doc : chunk.docs){
+                if(!callback(doc.first, move(doc.second))){
+                    code = PARSE_CANCELLED;
+                    break;
+                }
+            }
+            // 交付后立即释放, 内存占用只与在途的块数有关
+            vector<pair<size_t, Json>>().swap(chunk.docs);
+            scheduler.delivered();
+        }
+        scheduler.stop();
+        for(thread& worker : workers)
+            worker.join();
+        return code;
+    }
+
+    ParseCode NdjsonReader::parse(string_view text, const vector<JsonHandler*>& handlers){
+        if(handlers.empty() || find(handlers.begin(), handlers.end(), nullptr) != handlers.end())
+            return PARSE_INVALID_ARGUMENT;
+        vector<NdjsonChunk> chunks = splitChunks(text, _options.chunkSize);
+        size_t threads = min(handlers.size(), chunks.size());
+        // 没有交付线程, 不限制在途的块数
+        ChunkScheduler scheduler(chunks.size(), chunks.size());
+        mutex errorMutex;
+        size_t errorLine = SIZE_MAX;
+        ParseCode error = PARSE_OK;
+        vector<thread> workers;
+        for(size_t t = 0; t < threads; t++){
+            workers.emplace_back([&, t]{
+                JsonHandler& handler = *handlers[t];
+                size_t index;
+                while(scheduler.claim(index)){
+                    forEachLine(chunks[index], [&](size_t line, string_view s){
+                        ParseCode code = Json::parse(s, handler);
+                        if(code == PARSE_OK)
+                            return true;
+                        lock_guard<mutex> lock(errorMutex);
+                        if(line < errorLine){
+                            errorLine = line;
+                            error = code;
+                        }
+                        if(code == PARSE_CANCELLED)
+                            scheduler.stop();
+                        return code != PARSE_CANCELLED;
+                    });
+                }
+            });
+        }
+        for(thread& worker : workers)
+            worker.join();
+        return error;
+    }
+
+    Json Json::parse(string_view str){
+        DomBuilder builder;
+        Parser<DomBuilder> parser(str, builder);
+        return builder.result(parser.parse());
+    }
+
+    Json Json::parse(const char* data, size_t len){
+        return parse(string_view(data, len));
+    }
+
+    Json Json::parse(string_view str, const ParseOptions& options){
+        if(options.lazy)
+            return parseLazy(str, options);
+        JsonStats* _stats = options.stats;
+        SPARK_JSON_TIMER(parseNanos);
+        DomBuilder builder(options);
+        Parser<DomBuilder> parser(str, builder, options.resource);
+        parser.setStats(_stats);
+        return builder.result(parser.parse());
+    }
+
+    Json Json::parse(string_view str, Arena& arena){
+        ParseOptions options;
+        options.arena = &arena;
+        return parse(str, options);
+    }
+
+    Json Json::parse_file(const string& path, const ParseOptions& options){
+        shared_ptr<MappedFile> file = make_shared<MappedFile>(path);
+        if(!file->ok()){
+            Json json;
+            json.setErrorCode(PARSE_FILE_ERROR);
+            return json;
+        }
+        // 惰性解析的节点引用文件内容, 由文档持有映射
+        if(options.lazy)
+            return parseLazy(file->view(), options, file);
+        return parse(file->view(), options);
+    }
+
+    ParseCode Json::parse(string_view str, JsonHandler& handler){
+        Parser<JsonHandler> parser(str, handler);
+        return parser.parse();
     }
 
 } // SparkJson
\ No newline at end of file
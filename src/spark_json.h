@@ -2,10 +2,20 @@
 #define SPARK_JSON_H
 
 #include <iostream>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
-#include <map>
+#include <memory_resource>
+#include <algorithm>
+#include <initializer_list>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <atomic>
+#include <unordered_map>
+#include <tuple>
 
 namespace SparkJson
 {
@@ -33,16 +43,370 @@ namespace SparkJson
         PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
         PARSE_MISS_KEY,
         PARSE_MISS_COLON,
-        PARSE_MISS_COMMA_OR_CURLY_BRACKET
+        PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+        PARSE_CANCELLED,
+        PARSE_FILE_ERROR,
+        PARSE_INVALID_MSGPACK,
+        PARSE_INVALID_ARGUMENT
     };
 
     class JsonValue;
+    class Json;
+    class DomBuilder;
+    class Arena;
+    class JsonHandler;
+    class JsonSink;
+    class KeyPool;
+    class JsonPointer;
+
+    // 对象的键. 不超过 kInlineCapacity 字节的键直接存放在对象内, 不分配内存;
+    // 更长的键放在带引用计数的不可变存储中, 拷贝时共享同一份.
+    // 经 KeyPool 驻留的相同键共享存储, 键之间比较时先比较指针
+    class JsonKey{
+      public:
+        static const size_t kInlineCapacity = 23;
+
+        JsonKey() noexcept { _buf[kInlineCapacity] = 0; }
+        JsonKey(const char* str) : JsonKey(std::string_view(str)){}
+        JsonKey(const std::string& str) : JsonKey(std::string_view(str)){}
+        JsonKey(std::string_view str) : JsonKey(str, nullptr){}
+        // 超出内联容量的键从 resource 分配, 为空时使用全局的 operator new.
+        // 键 (以及它的副本) 不能比 resource 活得更久
+        JsonKey(std::string_view str, std::pmr::memory_resource* resource);
+        JsonKey(const JsonKey& other) noexcept{
+            memcpy(_buf, other._buf, sizeof _buf);
+            if(shared())
+                rep()->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        JsonKey(JsonKey&& other) noexcept{
+            memcpy(_buf, other._buf, sizeof _buf);
+            other._buf[kInlineCapacity] = 0;
+        }
+        JsonKey& operator=(const JsonKey& other) noexcept{
+            if(this != &other)
+                *this = JsonKey(other);
+            return *this;
+        }
+        JsonKey& operator=(JsonKey&& other) noexcept{
+            if(this != &other){
+                release();
+                memcpy(_buf, other._buf, sizeof _buf);
+                other._buf[kInlineCapacity] = 0;
+            }
+            return *this;
+        }
+        ~JsonKey() { release(); }
+
+        const char* data() const { return shared() ? rep()->data : _buf; }
+        size_t size() const { return shared() ? rep()->size : static_cast<uint8_t>(_buf[kInlineCapacity]); }
+        size_t length() const { return size(); }
+        bool empty() const { return size() == 0; }
+        std::string_view view() const { return std::string_view(data(), size()); }
+        operator std::string_view() const { return view(); }
+        std::string str() const { return std::string(data(), size()); }
+        int compare(std::string_view other) const { return view().compare(other); }
+
+        // 两个键是否指向同一份共享存储
+        bool sameStorage(const JsonKey& other) const{
+            return shared() && other.shared() && rep() == other.rep();
+        }
+
+        friend bool operator==(const JsonKey& a, const JsonKey& b){
+            return a.sameStorage(b) || a.view() == b.view();
+        }
+        friend bool operator!=(const JsonKey& a, const JsonKey& b){
+            return !(a == b);
+        }
+        friend bool operator<(const JsonKey& a, const JsonKey& b){
+            return !a.sameStorage(b) && a.view() < b.view();
+        }
+        friend std::ostream& operator<<(std::ostream& os, const JsonKey& key){
+            return os << key.view();
+        }
+
+      private:
+        struct Rep{
+            std::atomic<size_t> refs;
+            std::pmr::memory_resource* resource;
+            size_t size;
+            char data[1];
+        };
+
+        static const uint8_t kShared = 0xFF;
+
+        bool shared() const { return static_cast<uint8_t>(_buf[kInlineCapacity]) == kShared; }
+        Rep* rep() const{
+            Rep* r;
+            memcpy(&r, _buf, sizeof r);
+            return r;
+        }
+        void release() noexcept;
+
+        // 内联时最后一个字节保存长度, 共享时为 kShared, 开头保存 Rep 指针
+        alignas(Rep*) char _buf[kInlineCapacity + 1];
+    };
+
+    // 扁平的键值表, 条目连续存放在 vector 中, 每个键不再单独分配树节点.
+    // 默认按键排序 (遍历顺序与 std::map 相同), 查找为二分;
+    // preserveOrder 时保持插入顺序, 另外维护一个按键排序的下标用于二分.
+    // 条目数不超过 kLinearLimit 时直接线性查找.
+    // 条目和下标使用 std::pmr 分配器, 拷贝时回到默认的 memory_resource
+    template<typename V>
+    class FlatMap{
+      public:
+        typedef JsonKey key_type;
+        typedef V mapped_type;
+        typedef std::pair<JsonKey, V> value_type;
+        typedef std::pmr::vector<value_type> container_type;
+        typedef typename container_type::allocator_type allocator_type;
+        // 与 std::set 一样只有只读的迭代器: 改写键会破坏排序和下标. 修改值通过 operator[]
+        typedef typename container_type::const_iterator iterator;
+        typedef typename container_type::const_iterator const_iterator;
+
+        static const size_t kLinearLimit = 8;
+
+        FlatMap() = default;
+        explicit FlatMap(bool preserveOrder, const allocator_type& alloc = allocator_type())
+            : _entries(alloc), _index(alloc), _preserveOrder(preserveOrder){}
+        FlatMap(std::initializer_list<value_type> init, bool preserveOrder = false) : _preserveOrder(preserveOrder){
+            _entries.reserve(init.size());
+            for(const value_type& kv : init)
+                insert(kv);
+        }
+        // 批量构造, 重复的键保留最后一个值. 沿用 entries 的分配器
+        FlatMap(container_type&& entries, bool preserveOrder)
+            : _entries(std::move(entries)), _index(_entries.get_allocator()), _preserveOrder(preserveOrder){
+            if(!preserveOrder){
+                sortEntries();
+                size_t n = 0;
+                for(size_t i = 0; i < _entries.size(); i++){
+                    if(n > 0 && _entries[n - 1].first == _entries[i].first)
+                        _entries[n - 1].second = std::move(_entries[i].second);
+                    else if(n++ != i)
+                        _entries[n - 1] = std::move(_entries[i]);
+                }
+                _entries.resize(n);
+                return;
+            }
+            if(buildIndex())
+                return;
+            // 有重复的键: 保留第一次出现的位置和最后一次的值
+            container_type all = std::move(_entries);
+            _entries.clear();
+            _index.clear();
+            for(value_type& kv : all){
+                // 只有插入成功时 kv 才会被移走
+                std::pair<size_t, bool> r = insertEntry(std::move(kv));
+                if(!r.second)
+                    _entries[r.first].second = std::move(kv.second);
+            }
+        }
+
+        bool preserveOrder() const { return _preserveOrder; }
+        size_t size() const { return _entries.size(); }
+        bool empty() const { return _entries.empty(); }
+        void reserve(size_t n){
+            _entries.reserve(n);
+            if(_preserveOrder)
+                _index.reserve(n);
+        }
+
+        const_iterator begin() const { return _entries.begin(); }
+        const_iterator end() const { return _entries.end(); }
+
+        const_iterator find(std::string_view key) const { return _entries.begin() + findPos(key); }
+        size_t count(std::string_view key) const { return findPos(key) != _entries.size(); }
+
+        // 键不存在时原地插入默认构造的值, 不经过临时的 value_type
+        V& operator[](const JsonKey& key){
+            size_t i = lowerBound(key.view());
+            if(!_preserveOrder){
+                if(i < _entries.size() && _entries[i].first == key)
+                    return _entries[i].second;
+                return _entries.emplace(_entries.begin() + i, std::piecewise_construct,
+                                        std::forward_as_tuple(key), std::forward_as_tuple())->second;
+            }
+            if(i < _index.size() && _entries[_index[i]].first == key)
+                return _entries[_index[i]].second;
+            _index.insert(_index.begin() + i, static_cast<uint32_t>(_entries.size()));
+            _entries.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+            return _entries.back().second;
+        }
+
+        std::pair<iterator, bool> insert(const value_type& kv){
+            return insert(value_type(kv));
+        }
+
+        std::pair<iterator, bool> insert(value_type&& kv){
+            std::pair<size_t, bool> r = insertEntry(std::move(kv));
+            return { _entries.cbegin() + r.first, r.second };
+        }
+
+        size_t erase(std::string_view key){
+            size_t i = lowerBound(key);
+            if(!_preserveOrder){
+                if(i == _entries.size() || _entries[i].first.view() != key)
+                    return 0;
+                _entries.erase(_entries.begin() + i);
+                return 1;
+            }
+            if(i == _index.size() || _entries[_index[i]].first.view() != key)
+                return 0;
+            uint32_t pos = _index[i];
+            _index.erase(_index.begin() + i);
+            for(uint32_t& x : _index)
+                if(x > pos)
+                    x--;
+            _entries.erase(_entries.begin() + pos);
+            return 1;
+        }
+
+      private:
+        // 返回条目在 _entries 中的位置, 以及是否新插入. 键已存在时 kv 不会被移走
+        std::pair<size_t, bool> insertEntry(value_type&& kv){
+            size_t i = lowerBound(kv.first.view());
+            if(!_preserveOrder){
+                if(i < _entries.size() && _entries[i].first == kv.first)
+                    return { i, false };
+                _entries.insert(_entries.begin() + i, std::move(kv));
+                return { i, true };
+            }
+            if(i < _index.size() && _entries[_index[i]].first == kv.first)
+                return { _index[i], false };
+            _index.insert(_index.begin() + i, static_cast<uint32_t>(_entries.size()));
+            _entries.push_back(std::move(kv));
+            return { _entries.size() - 1, true };
+        }
+
+        // 稳定排序, 重复的键保持原有先后. 小表用插入排序, 避免 stable_sort 的临时缓冲区
+        void sortEntries(){
+            size_t n = _entries.size();
+            if(n > 2 * kLinearLimit){
+                std::stable_sort(_entries.begin(), _entries.end(),
+                    [](const value_type& a, const value_type& b){ return a.first < b.first; });
+                return;
+            }
+            for(size_t i = 1; i < n; i++){
+                if(!(_entries[i].first < _entries[i - 1].first))
+                    continue;
+                value_type tmp = std::move(_entries[i]);
+                size_t j = i;
+                for(; j > 0 && tmp.first < _entries[j - 1].first; j--)
+                    _entries[j] = std::move(_entries[j - 1]);
+                _entries[j] = std::move(tmp);
+            }
+        }
+
+        // 按键排序生成下标, 有重复的键时返回 false
+        bool buildIndex(){
+            size_t n = _entries.size();
+            _index.resize(n);
+            for(size_t i = 0; i < n; i++)
+                _index[i] = static_cast<uint32_t>(i);
+            auto less = [this](uint32_t a, uint32_t b){ return _entries[a].first < _entries[b].first; };
+            if(n > 2 * kLinearLimit)
+                std::sort(_index.begin(), _index.end(), less);
+            else{
+                for(size_t i = 1; i < n; i++){
+                    uint32_t tmp = _index[i];
+                    size_t j = i;
+                    for(; j > 0 && less(tmp, _index[j - 1]); j--)
+                        _index[j] = _index[j - 1];
+                    _index[j] = tmp;
+                }
+            }
+            for(size_t i = 1; i < n; i++)
+                if(_entries[_index[i]].first == _entries[_index[i - 1]].first)
+                    return false;
+            return true;
+        }
+
+        const JsonKey& keyAt(size_t i) const {
+            return _preserveOrder ? _entries[_index[i]].first : _entries[i].first;
+        }
+
+        // 有序模式下返回 _entries 中的位置, 保序模式下返回 _index 中的位置
+        size_t lowerBound(std::string_view key) const{
+            size_t lo = 0, hi = _entries.size();
+            while(lo < hi){
+                size_t mid = (lo + hi) / 2;
+                if(keyAt(mid).view() < key)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        size_t findPos(std::string_view key) const{
+            size_t n = _entries.size();
+            if(n <= kLinearLimit){
+                for(size_t i = 0; i < n; i++)
+                    if(_entries[i].first.view() == key)
+                        return i;
+                return n;
+            }
+            size_t i = lowerBound(key);
+            if(i == n || keyAt(i).view() != key)
+                return n;
+            return _preserveOrder ? _index[i] : i;
+        }
+
+        container_type _entries;
+        std::pmr::vector<uint32_t> _index;
+        bool _preserveOrder = false;
+    };
+
+    // 解析和输出的统计, 可以导出到监控系统. 只有定义了 SPARK_JSON_STATS (CMake 选项
+    // SPARK_JSON_STATS) 时才收集, 否则相关代码全部编译掉, 传入的 JsonStats 保持不变.
+    // 多次调用的结果累加, 需要时由调用者清零
+    struct JsonStats{
+#ifdef SPARK_JSON_STATS
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+        size_t nodes[JSON_OBJECT + 1] = {};     // 按 JsonType 计数
+        size_t stringBytes = 0;     // 字符串值和键的字节数
+        size_t allocations = 0;     // 解析时创建的节点和容器缓冲区数
+        size_t maxDepth = 0;
+        size_t outputBytes = 0;
+        // 各阶段耗时 (纳秒). string/number/build 是 parse 的一部分
+        uint64_t parseNanos = 0;
+        uint64_t stringNanos = 0;
+        uint64_t numberNanos = 0;
+        uint64_t buildNanos = 0;
+        uint64_t dumpNanos = 0;
+    };
+
+    struct ParseOptions{
+        // 节点, 容器, 字符串和长键从 arena 中分配, arena 必须比解析出的 Json 活得更久
+        Arena* arena = nullptr;
+        // 节点, 容器, 字符串, 长键和解析时的临时数据都从 resource 分配, 例如请求级的
+        // std::pmr::monotonic_buffer_resource, 请求结束时整体丢弃. resource 必须比解析出的
+        // Json 活得更久. 同时设置 arena 时除临时数据外以 arena 为准; 设置 keyPool 时长键由 keyPool 分配
+        std::pmr::memory_resource* resource = nullptr;
+        // 对象按文档中的顺序保存键, 默认按键排序
+        bool preserveOrder = false;
+        // 对象的键在 keyPool 中驻留, 相同的键共享存储. 键带引用计数, keyPool 可以先于 Json 销毁
+        KeyPool* keyPool = nullptr;
+        // 统计解析过程, 见 JsonStats. 惰性解析只统计校验阶段, NdjsonReader 忽略此项
+        JsonStats* stats = nullptr;
+        // 惰性解析: 先校验整个文档并记录容器的位置, 容器在第一次被访问时才创建子节点,
+        // 未访问的子树不分配内存. 输入缓冲区必须比解析出的 Json 活得更久. StreamParser 忽略此选项.
+        // 与立即解析一样, 多个线程可以同时读取同一个 Json: 每个容器只展开一次, 展开时使用
+        // 全局分配器, 不使用 arena, resource 和 keyPool (它们只用于根节点)
+        bool lazy = false;
+    };
 
     class Json final{
       public:
 
-        typedef std::vector<Json> array;
-        typedef std::map<std::string, Json> object;
+        // 容器使用 std::pmr 分配器, 默认走全局 new/delete, 解析时可以改用
+        // ParseOptions::resource. 复制出的容器总是使用默认的 memory_resource.
+        // 仍然可以从 std::vector<Json> 构造, 元素复制 (或移动) 到 array 中
+        typedef std::pmr::vector<Json> array;
+        typedef FlatMap<Json> object;
 
         Json();     // null
         Json(nullptr_t);    // null
@@ -52,22 +416,52 @@ namespace SparkJson
         Json(int64_t value);
         Json(uint64_t value);
         Json(const std::string& value);   // string
+        Json(std::string&& value);        // string
         Json(const char* value);    // string
         Json(const array& value);   // array
         Json(array&& value);        // array
+        Json(const std::vector<Json>& value);   // array
+        Json(std::vector<Json>&& value);        // array
         Json(const object& value);  // object
         Json(object&& value);       // object
-        //Json(const Json& json);
-        //Json(Json&& json);
+        Json(const Json& other);
+        Json(Json&& other) noexcept;
+        Json& operator=(const Json& other);
+        Json& operator=(Json&& other) noexcept;
+        ~Json();
 
-        static Json parse(const std::string& str);
+        // 直接读取调用者的缓冲区, 不做拷贝, 以长度为边界
+        static Json parse(std::string_view str);
+        static Json parse(const char* data, size_t len);
+        static Json parse(std::string_view str, const ParseOptions& options);
+        static Json parse(std::string_view str, Arena& arena);
+        // SAX: 不构建 Json 树, 逐个事件回调 handler
+        static ParseCode parse(std::string_view str, JsonHandler& handler);
+        // 通过 MappedFile 读取整个文件后解析, 不再额外拷贝. 无法打开或读取时返回 null,
+        // 错误码为 PARSE_FILE_ERROR. 惰性解析时返回的 Json 持有文件映射
+        static Json parse_file(const std::string& path, const ParseOptions& options = ParseOptions());
         void dump(std::string& out) const;
+        // 流式输出到 sink, 调用者负责在结束时 flush
+        void dump(JsonSink& out) const;
+        // 同时统计输出的节点, 字节数和耗时, 见 JsonStats
+        void dump(std::string& out, JsonStats& stats) const;
         const std::string dump() const{
             std::string out;
             dump(out);
             return out;
         }
 
+        // MessagePack 编码, 追加到 out. int/int64_t/uint64_t 分别使用有符号的最短格式,
+        // int 64 和 uint 64, 解码后数字的宽度与编码前一致
+        void dump_msgpack(std::string& out) const;
+        // 解码 MessagePack, 选项与文本解析相同 (惰性解析除外). 截断或
+        // 没有对应 JsonType 的格式 (bin/ext) 返回 PARSE_INVALID_MSGPACK, 键不是字符串时
+        // 返回 PARSE_MISS_KEY. 字符串不做 UTF-8 校验
+        static Json parse_msgpack(std::string_view data, const ParseOptions& options = ParseOptions());
+        // 编码为 tape 格式追加到 out, 用 JsonTapeView 原地读取. 编码结果超过 4 GB 时
+        // 撤销追加的内容并返回 false
+        bool dump_tape(std::string& out) const;
+
         void setErrorCode(int code) { _errorCode = code; }
         int getErrorCode() const { return _errorCode; }
 
@@ -80,35 +474,431 @@ namespace SparkJson
         int64_t to_int64_t() const;
         uint64_t to_uint64_t() const;
         double to_double() const;
-        const std::string& to_string() const;
+        std::string to_string() const;             // 复制一份
+        std::string_view to_string_view() const;   // 不复制, 在 Json 存活期间有效
         const array& to_array() const;
         const object& to_object() const;
 
         const Json& operator[](size_t i) const;
         const Json& operator[](const std::string& key) const;
+        // 按 JSON Pointer 查找, 路径不存在时返回 null
+        const Json& at(const JsonPointer& pointer) const;
+
+        // 修改. 节点还被其他 Json 引用时先复制这一层 (写时复制), 子节点继续共享.
+        // 下标读取总是只读的, 修改通过 mutableAt. null 先变为空数组/空对象; 其他类型不符时
+        // 不修改, mutableAt 返回 nullptr, set/push_back 返回 false.
+        // 返回的指针在容器下一次修改前有效
+        Json* mutableAt(size_t i);                  // 越界时用 null 补齐
+        Json* mutableAt(const std::string& key);    // 键不存在时插入 null
+        bool set(const std::string& key, Json value);
+        bool push_back(Json value);
+        size_t erase(const std::string& key);
+        bool erase(size_t i);
         
 
       private:
-        std::shared_ptr<JsonValue> _value;
+        friend class DomBuilder;
+        explicit Json(std::shared_ptr<JsonValue> value);
+
+        template<typename T>
+        T numberAs() const;
+        array& mutableArray();
+        object& mutableObject();
+        template<typename Out>
+        void dumpTo(Out& out) const;
+        void dumpTape(std::string& out) const;
+
+        // null/bool/number 直接存放在 union 中, 读取时不需要分配和虚函数调用;
+        // 只有字符串和容器才持有堆上的 JsonValue
+        enum Kind : uint8_t{
+            KIND_NULL = 0,
+            KIND_BOOL,
+            KIND_INT,
+            KIND_INT64,
+            KIND_UINT64,
+            KIND_DOUBLE,
+            KIND_VALUE
+        };
+
+        union{
+            bool _bool;
+            int _int;
+            int64_t _int64;
+            uint64_t _uint64;
+            double _double;
+            std::shared_ptr<JsonValue> _value;
+        };
+        Kind _kind;
         int _errorCode = 0;
     };
 
+    // 预先编译的 JSON Pointer (RFC 6901), 例如 "/a/b/3/c". 编译时解码 ~0/~1 并
+    // 预先算出数组下标, 之后可以反复求值, 求值过程不分配内存.
+    // 格式错误时 valid() 返回 false, 求值结果为 null
+    class JsonPointer{
+      public:
+        JsonPointer() = default;    // 空路径, 指向根节点
+        explicit JsonPointer(std::string_view pointer);
+
+        bool valid() const { return _valid; }
+        size_t size() const { return _tokens.size(); }
+        const Json& resolve(const Json& root) const;
+
+      private:
+        friend class JsonExtractor;
+        friend class JsonTapeView;
+
+        struct Token{
+            JsonKey key;
+            // 可以作为数组下标时为对应的值, 否则为 kNotIndex
+            size_t index;
+        };
+        static const size_t kNotIndex = static_cast<size_t>(-1);
+
+        std::vector<Token> _tokens;
+        bool _valid = true;
+    };
+
+    // 一次扫描原始文本, 同时取出多条路径上的值. 不构建 Json 节点, 不在路径上的子树
+    // 只做括号匹配后跳过. 字符串结果指向输入或内部缓冲区, 在下一次 extract 之前有效
+    class JsonExtractor{
+      public:
+        // 默认重复的键以先出现的为准, 所有路径都找到后立即停止, 不再检查剩余的输入.
+        // lastDuplicateWins 时与 Json::parse 一样以最后出现的为准, 被覆盖的子树中的结果作废,
+        // 因此总是扫描完整个输入
+        explicit JsonExtractor(bool lastDuplicateWins = false) : _lastDuplicateWins(lastDuplicateWins){}
+
+        class Value{
+          public:
+            bool found() const { return _found; }
+            JsonType type() const { return _type; }
+            bool to_bool() const { return _scalar.to_bool(); }
+            int64_t to_int64_t() const { return _scalar.to_int64_t(); }
+            uint64_t to_uint64_t() const { return _scalar.to_uint64_t(); }
+            double to_double() const { return _scalar.to_double(); }
+            std::string_view to_string() const { return _string; }
+            // 值在输入中的原始文本, 容器也可以取到
+            std::string_view raw() const { return _raw; }
+
+          private:
+            friend class JsonExtractor;
+
+            bool _found = false;
+            JsonType _type = JSON_NULL;
+            Json _scalar;
+            std::string_view _string;
+            std::string_view _raw;
+            std::string _storage;
+        };
+
+        // 返回结果的下标, 相同的路径返回同一个下标. 无效的路径永远找不到
+        size_t add(const JsonPointer& path);
+        size_t size() const { return _values.size(); }
+        ParseCode extract(std::string_view text);
+        const Value& operator[](size_t i) const { return _values[i]; }
+
+      private:
+        struct Walker;
+        static const size_t kNone = static_cast<size_t>(-1);
+
+        struct Node{
+            JsonKey key;
+            size_t index;
+            size_t slot;
+            std::vector<size_t> children;
+            bool visited = false;   // 本次 extract 中是否已经进入过
+        };
+
+        bool _lastDuplicateWins;
+        std::vector<Node> _nodes;
+        std::vector<Value> _values;
+    };
+
     class JsonValue{
       protected:
         friend class Json;
-        virtual const size_t size() const = 0;
-        virtual const JsonType type() const = 0;
+        virtual size_t size() const = 0;
+        virtual JsonType type() const = 0;
         virtual void dump(std::string& out) const = 0;
-        virtual bool bool_value() const;
-        virtual int int_value() const;
-        virtual int64_t int64_t_value() const;
-        virtual uint64_t uint64_t_value() const;
-        virtual double double_value() const;
-        virtual const std::string& string_value() const;
+        virtual void dump(JsonSink& out) const = 0;
+        virtual std::string_view string_value() const;
         virtual const Json::array& array_value() const;
         virtual const Json::object& object_value() const;
         virtual const Json& operator[](size_t i) const;
         virtual const Json& operator[](const std::string& key) const;
+        // 可以原地修改的容器返回自身的数据, 其余节点 (空容器单例, 惰性节点等) 返回 nullptr
+        virtual Json::array* mutable_array() { return nullptr; }
+        virtual Json::object* mutable_object() { return nullptr; }
+    };
+
+    // 序列化的输出目标. 内容先写入固定大小的缓冲区, 写满时交给 write() 输出,
+    // 输出大文档时内存占用有上限. 派生类在析构时 flush 剩余内容
+    class JsonSink{
+      public:
+        explicit JsonSink(size_t bufferSize = 64 * 1024);
+        virtual ~JsonSink();
+        JsonSink(const JsonSink&) = delete;
+        JsonSink& operator=(const JsonSink&) = delete;
+
+        void append(const char* data, size_t len){
+            if(len > static_cast<size_t>(_end - _cur)){
+                appendSlow(data, len);
+                return;
+            }
+            memcpy(_cur, data, len);
+            _cur += len;
+        }
+        JsonSink& operator+=(char ch){
+            if(_cur == _end)
+                flush();
+            *_cur++ = ch;
+            return *this;
+        }
+        JsonSink& operator+=(const char* str){
+            append(str, strlen(str));
+            return *this;
+        }
+
+        void flush();
+
+      protected:
+        virtual void write(const char* data, size_t len) = 0;
+
+      private:
+        void appendSlow(const char* data, size_t len);
+
+        std::unique_ptr<char[]> _buffer;
+        char* _cur;
+        char* _end;
+    };
+
+    // 写入文件描述符, 处理部分写入和 EINTR; 出错后 error() 返回 errno 并停止写入
+    class FdSink : public JsonSink{
+      public:
+        explicit FdSink(int fd, size_t bufferSize = 64 * 1024) : JsonSink(bufferSize), _fd(fd){}
+        ~FdSink() override;
+        int error() const { return _error; }
+      protected:
+        void write(const char* data, size_t len) override;
+      private:
+        int _fd;
+        int _error = 0;
+    };
+
+    class FileSink : public JsonSink{
+      public:
+        explicit FileSink(FILE* file, size_t bufferSize = 64 * 1024) : JsonSink(bufferSize), _file(file){}
+        ~FileSink() override;
+        bool error() const { return _error; }
+      protected:
+        void write(const char* data, size_t len) override;
+      private:
+        FILE* _file;
+        bool _error = false;
+    };
+
+    class CallbackSink : public JsonSink{
+      public:
+        typedef std::function<void(const char* data, size_t len)> Callback;
+        explicit CallbackSink(Callback callback, size_t bufferSize = 64 * 1024)
+            : JsonSink(bufferSize), _callback(std::move(callback)){}
+        ~CallbackSink() override;
+      protected:
+        void write(const char* data, size_t len) override;
+      private:
+        Callback _callback;
+    };
+
+    // SAX 解析的回调接口. 回调返回 false 时立即停止解析, parse 返回 PARSE_CANCELLED.
+    // on_key/on_string 的参数只在回调期间有效. 整数默认转给 on_number
+    class JsonHandler{
+      public:
+        virtual ~JsonHandler() = default;
+
+        virtual bool on_null() { return true; }
+        virtual bool on_bool(bool /*value*/) { return true; }
+        virtual bool on_number(double /*value*/) { return true; }
+        virtual bool on_int64(int64_t value) { return on_number(static_cast<double>(value)); }
+        virtual bool on_uint64(uint64_t value) { return on_number(static_cast<double>(value)); }
+        virtual bool on_string(std::string_view /*value*/) { return true; }
+        virtual bool on_key(std::string_view /*key*/) { return true; }
+        virtual bool on_start_object() { return true; }
+        virtual bool on_end_object() { return true; }
+        virtual bool on_start_array() { return true; }
+        virtual bool on_end_array() { return true; }
+    };
+
+    // 增量解析: 输入可以按任意分片多次 feed, 字符串/转义/数字可以跨分片,
+    // finish 返回与 Json::parse 相同的 Json 和错误码, 之后可以解析下一个文档
+    class StreamParser{
+      public:
+        explicit StreamParser(const ParseOptions& options = ParseOptions());
+        ~StreamParser();
+        StreamParser(const StreamParser&) = delete;
+        StreamParser& operator=(const StreamParser&) = delete;
+
+        // 返回目前为止的解析状态, 出错后忽略后续输入
+        ParseCode feed(const char* data, size_t len);
+        ParseCode feed(std::string_view data) { return feed(data.data(), data.size()); }
+        Json finish();
+
+      private:
+        struct Impl;
+        std::unique_ptr<Impl> _impl;
+    };
+
+    // 键的驻留表. 同一个表中 intern 出的相同长键共享一份存储,
+    // 短键本身内联存放, 不进入表中. 非线程安全.
+    class KeyPool{
+      public:
+        KeyPool() = default;
+        KeyPool(const KeyPool&) = delete;
+        KeyPool& operator=(const KeyPool&) = delete;
+
+        JsonKey intern(std::string_view key);
+        size_t size() const { return _keys.size(); }
+        void clear() { _keys.clear(); }
+
+      private:
+        // string_view 指向对应 JsonKey 的共享存储, rehash 时不会失效
+        std::unordered_map<std::string_view, JsonKey> _keys;
+    };
+
+    struct NdjsonOptions{
+        // 工作线程数, 0 表示 std::thread::hardware_concurrency()
+        size_t threads = 0;
+        // 每块的目标字节数, 实际在其后的第一个换行处切分
+        size_t chunkSize = 1 << 20;
+        // 按行的顺序交付, 否则按块完成的顺序交付
+        bool ordered = true;
+        // 每行的解析选项. arena, resource 和 keyPool 不是线程安全的, 会被忽略, 每行使用全局分配器
+        ParseOptions parse;
+    };
+
+    // 换行分隔的 JSON (NDJSON). 按换行把输入切成块, 工作线程从共享的队列中领取块并行解析,
+    // 结果在调用 parse 的线程上交付, 回调不会并发执行. 空白行被跳过, 行号从 0 开始计数.
+    // 同时在途的块数有上限, 交付慢时工作线程会等待
+    class NdjsonReader{
+      public:
+        // 返回 false 时停止解析, parse 返回 PARSE_CANCELLED. 出错的行也会交付, 错误码在 json 中.
+        // callback 为空, handlers 为空或含空指针时不解析, 返回 PARSE_INVALID_ARGUMENT
+        typedef std::function<bool(size_t line, Json&& json)> Callback;
+
+        explicit NdjsonReader(const NdjsonOptions& options = NdjsonOptions());
+
+        ParseCode parse(std::string_view text, const Callback& callback);
+        // SAX: 每个工作线程使用 handlers 中的一个, 线程数为 handlers.size().
+        // 同一个 handler 收到的行保持顺序, 返回行号最小的出错行的错误码
+        ParseCode parse(std::string_view text, const std::vector<JsonHandler*>& handlers);
+
+      private:
+        NdjsonOptions _options;
+    };
+
+    // 只读方式载入整个文件. 普通文件用 mmap 映射并提示顺序访问; 管道, 特殊文件,
+    // 映射失败或 Windows 上分块读入缓冲区. 打开或读取失败时 error() 返回 errno
+    class MappedFile{
+      public:
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool ok() const { return _error == 0; }
+        int error() const { return _error; }
+        bool mapped() const { return _mapped; }
+        std::string_view view() const { return std::string_view(_data, _size); }
+
+      private:
+        const char* _data = nullptr;
+        size_t _size = 0;
+        bool _mapped = false;
+        int _error = 0;
+        std::string _buffer;
+    };
+
+    // 在 Json::dump_tape 的输出上原地只读访问, 例如 MappedFile 映射的缓存文件或
+    // 共享内存, 不反序列化为 Json 节点, 构造时只检查头部. 容器记录自身的字节长度
+    // 和各元素的偏移, 跳过子树和按下标访问都是 O(1), 按键排序的对象可以二分查找.
+    // 偏移都是相对的, 缓冲区可以放在任意地址. 每次读取都检查边界, 损坏的数据
+    // 读出 null 而不会越界. 视图不持有缓冲区, 缓冲区必须比视图活得更久
+    class JsonTapeView{
+      public:
+        JsonTapeView() = default;
+        // 指向 tape 的根节点
+        explicit JsonTapeView(std::string_view tape);
+
+        // 头部不合法或查找的路径不存在时为 false, 此时表现为 null
+        bool valid() const { return _data != nullptr; }
+        JsonType type() const;
+        size_t size() const;    // 容器的元素个数, 其他类型为 1, 与 Json::size() 相同
+
+        bool to_bool() const;
+        int to_int() const;
+        int64_t to_int64_t() const;
+        uint64_t to_uint64_t() const;
+        double to_double() const;
+        std::string_view to_string() const;
+
+        JsonTapeView operator[](size_t i) const;
+        JsonTapeView operator[](std::string_view key) const;
+        // 对象中第 i 个条目的键, 顺序与原对象的遍历顺序相同
+        std::string_view key(size_t i) const;
+        JsonTapeView at(const JsonPointer& pointer) const;
+        // 把这棵子树反序列化为 Json
+        Json to_json() const;
+
+      private:
+        JsonTapeView(const char* data, size_t size, size_t pos) : _data(data), _size(size), _pos(pos){}
+
+        uint8_t tag() const;
+        // 越界时返回 0
+        template<typename T>
+        T read(size_t pos) const;
+        template<typename T>
+        T numberAs() const;
+        // 容器中第 i 个元素的位置, 越界时为 0 (根节点之前的头部, 不会是合法的元素)
+        size_t element(size_t i) const;
+        JsonTapeView entryValue(size_t entry) const;
+
+        const char* _data = nullptr;
+        size_t _size = 0;
+        size_t _pos = 0;
+    };
+
+    // 单调递增的内存池: 从大块内存中顺序切分, 不单独释放,
+    // release() 或析构时一次性归还所有内存块. 非线程安全.
+    // 内存块来自 upstream; Arena 本身也是 memory_resource, 可以交给其他 pmr 容器使用
+    class Arena : public std::pmr::memory_resource{
+      public:
+        explicit Arena(size_t blockSize = 64 * 1024,
+                       std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+        // 调用前必须先销毁所有从该 arena 解析出的 Json
+        void release();
+
+        size_t blockCount() const { return _blockCount; }
+        size_t bytesUsed() const { return _bytesUsed; }
+
+      private:
+        struct Block;
+        void newBlock(size_t minSize);
+
+        void* do_allocate(size_t size, size_t align) override { return allocate(size, align); }
+        void do_deallocate(void*, size_t, size_t) override{}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+        std::pmr::memory_resource* _upstream;
+        Block* _head = nullptr;
+        char* _cur = nullptr;
+        char* _end = nullptr;
+        size_t _blockSize;
+        size_t _blockCount = 0;
+        size_t _bytesUsed = 0;
     };
 
 } // SparkJson
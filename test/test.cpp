@@ -1,7 +1,46 @@
 #include "spark_json.hpp"
 #include <cstring>
+#include <cmath>
+#include <new>
+#include <cstdlib>
+#include <climits>
+#include <thread>
+#include <type_traits>
 using namespace SparkJson;
 
+// 统计堆分配次数, NDJSON 测试中会被多个线程同时修改
+static std::atomic<size_t> alloc_count{0};
+
+void* operator new(size_t size){
+    alloc_count++;
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    alloc_count++;
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+
+// std::pmr 的默认 memory_resource 使用带对齐参数的版本
+void* operator new(size_t size, std::align_val_t align){
+    alloc_count++;
+    size_t alignment = static_cast<size_t>(align);
+    void* p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+
 static int test_count = 0;
 static int test_pass = 0;
 static int main_ret = 0; 
@@ -97,6 +136,72 @@ void test_construct(){
     EXPECT_EQ_INT(Json("string").type(), JsonType::JSON_STRING);
     EXPECT_EQ_INT(Json(" ").type(), JsonType::JSON_STRING);
     EXPECT_EQ_INT(Json(" string ").type(), JsonType::JSON_STRING);
+    EXPECT_EQ_INT(Json("").type(), JsonType::JSON_STRING);
+
+    // 空字符串/空容器共享同一个节点
+    EXPECT_EQ_INT(Json(Json::array{}).type(), JsonType::JSON_ARRAY);
+    EXPECT_EQ_INT(Json(Json::object{}).type(), JsonType::JSON_OBJECT);
+    Json json = Json::parse("[ \"\" , [ ] , { } , \"\" ]");
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(json[0].type(), JsonType::JSON_STRING);
+    EXPECT_EQ_INT(json[1].type(), JsonType::JSON_ARRAY);
+    EXPECT_EQ_INT(json[2].type(), JsonType::JSON_OBJECT);
+    EXPECT_TRUE(json[0].to_string_view().data() == json[3].to_string_view().data());
+    EXPECT_TRUE(&json[1].to_array() == &Json(Json::array{}).to_array());
+
+    // 与 std::string / std::vector 的接口保持源码兼容
+    Json text = Json::parse("\"" + std::string(40, 't') + "\"");
+    const std::string& copy = text.to_string();
+    EXPECT_EQ_SIZE_T(40, strlen(text.to_string().c_str()));
+    EXPECT_TRUE(copy == text.to_string_view());
+    std::vector<Json> values = { 1, "a" };
+    EXPECT_EQ_STRING(Json(values).dump(), std::string("[1, \"a\"]"));
+    EXPECT_EQ_STRING(Json(std::vector<Json>{ true, nullptr }).dump(), std::string("[true, null]"));
+    EXPECT_EQ_SIZE_T(2, values.size());
+}
+
+void test_scalar(){
+    // 标量存放在 Json 内部, 不经过 JsonValue
+    EXPECT_EQ_SIZE_T(24, sizeof(Json));
+
+    Json json = Json(static_cast<int64_t>(-9007199254740993LL));
+    EXPECT_EQ_INT(json.type(), JsonType::JSON_NUMBER);
+    EXPECT_TRUE(json.to_int64_t() == -9007199254740993LL);
+    json = Json(static_cast<uint64_t>(18446744073709551615ULL));
+    EXPECT_TRUE(json.to_uint64_t() == 18446744073709551615ULL);
+    EXPECT_EQ_SIZE_T(1, json.size());
+    EXPECT_EQ_INT(json[0].type(), JsonType::JSON_NULL);
+    EXPECT_EQ_INT(json["key"].type(), JsonType::JSON_NULL);
+    EXPECT_EQ_SIZE_T(0, json.to_string().size());
+
+    json = Json(2.5);
+    EXPECT_EQ_INT(json.to_int(), 2);
+    EXPECT_EQ_DOUBLE(json.to_double(), 2.5);
+    EXPECT_FALSE(json.to_bool());
+
+    // 超出整数范围的 double 截断到上下界, NaN 为 0
+    json = Json::parse("1e300");
+    EXPECT_EQ_INT(json.to_int(), INT_MAX);
+    EXPECT_TRUE(json.to_int64_t() == INT64_MAX);
+    EXPECT_TRUE(json.to_uint64_t() == UINT64_MAX);
+    json = Json::parse("-1e300");
+    EXPECT_EQ_INT(json.to_int(), INT_MIN);
+    EXPECT_TRUE(json.to_int64_t() == INT64_MIN);
+    EXPECT_TRUE(Json(-1.5).to_uint64_t() == 0);
+    EXPECT_EQ_INT(Json(-1.5).to_int(), -1);
+    EXPECT_EQ_INT(Json(std::nan("")).to_int(), 0);
+
+    // 拷贝/移动在标量和容器之间切换
+    Json other = Json::array{ 1, "abc" };
+    json = other;
+    EXPECT_EQ_INT(json.type(), JsonType::JSON_ARRAY);
+    Json moved = std::move(other);
+    EXPECT_EQ_INT(moved.size(), 2);
+    EXPECT_EQ_INT(other.type(), JsonType::JSON_NULL);
+    json = json[1];
+    EXPECT_EQ_STRING(json.to_string(), "abc");
+    json = true;
+    EXPECT_TRUE(json.to_bool());
 }
 
 void test_parse(){
@@ -132,14 +237,14 @@ void test_parse(){
     TEST_DOUBLE("1e309", 0, ParseCode::PARSE_NUMBER_TOO_BIG);
     TEST_DOUBLE("-1e309", 0, ParseCode::PARSE_NUMBER_TOO_BIG);
     TEST_DOUBLE("1.0000000000000002", 1.0000000000000002, ParseCode::PARSE_OK); /* the smallest number > 1 */
-    //TEST_DOUBLE("4.9406564584124654e-324", 4.9406564584124654e-324, ParseCode::PARSE_OK); /* minimum denormal */
-    //TEST_DOUBLE("-4.9406564584124654e-324", -4.9406564584124654e-324, ParseCode::PARSE_OK);
-    //TEST_DOUBLE("2.2250738585072009e-308", 2.2250738585072009e-308, ParseCode::PARSE_OK);  /* Max subnormal double */
-    //TEST_DOUBLE("-2.2250738585072009e-308", -2.2250738585072009e-308, ParseCode::PARSE_OK);
-    //TEST_DOUBLE("2.2250738585072014e-308", 2.2250738585072014e-308, ParseCode::PARSE_OK);  /* Min normal positive double */
-    //TEST_DOUBLE("-2.2250738585072014e-308", -2.2250738585072014e-308, ParseCode::PARSE_OK);
-    //TEST_DOUBLE("1.7976931348623157e+308", 1.7976931348623157e+308, ParseCode::PARSE_OK);  /* Max double */
-    //TEST_DOUBLE("-1.7976931348623157e+308", -1.7976931348623157e+308, ParseCode::PARSE_OK);
+    TEST_DOUBLE("4.9406564584124654e-324", 4.9406564584124654e-324, ParseCode::PARSE_OK); /* minimum denormal */
+    TEST_DOUBLE("-4.9406564584124654e-324", -4.9406564584124654e-324, ParseCode::PARSE_OK);
+    TEST_DOUBLE("2.2250738585072009e-308", 2.2250738585072009e-308, ParseCode::PARSE_OK);  /* Max subnormal double */
+    TEST_DOUBLE("-2.2250738585072009e-308", -2.2250738585072009e-308, ParseCode::PARSE_OK);
+    TEST_DOUBLE("2.2250738585072014e-308", 2.2250738585072014e-308, ParseCode::PARSE_OK);  /* Min normal positive double */
+    TEST_DOUBLE("-2.2250738585072014e-308", -2.2250738585072014e-308, ParseCode::PARSE_OK);
+    TEST_DOUBLE("1.7976931348623157e+308", 1.7976931348623157e+308, ParseCode::PARSE_OK);  /* Max double */
+    TEST_DOUBLE("-1.7976931348623157e+308", -1.7976931348623157e+308, ParseCode::PARSE_OK);
 
     // string
     TEST_STRING("\" \"", " ", ParseCode::PARSE_OK);
@@ -151,6 +256,92 @@ void test_parse(){
     TEST_STRING("\"\\ud834\\udd1e\"", "\xF0\x9D\x84\x9E", ParseCode::PARSE_OK);  /* G clef sign U+1D11E */
 }
 
+void test_parse_integer(){
+    // 整数保持 int64_t/uint64_t 精度
+    Json json = Json::parse("9007199254740993");
+    TEST_PARSE_JSON(json, JsonType::JSON_NUMBER, ParseCode::PARSE_OK);
+    EXPECT_TRUE(json.to_int64_t() == 9007199254740993LL);
+    json = Json::parse("-9223372036854775808");
+    TEST_PARSE_JSON(json, JsonType::JSON_NUMBER, ParseCode::PARSE_OK);
+    EXPECT_TRUE(json.to_int64_t() == INT64_MIN);
+    json = Json::parse("18446744073709551615");
+    TEST_PARSE_JSON(json, JsonType::JSON_NUMBER, ParseCode::PARSE_OK);
+    EXPECT_TRUE(json.to_uint64_t() == UINT64_MAX);
+    EXPECT_EQ_STRING(json.dump(), "18446744073709551615");
+    json = Json::parse("[ 123 , -45 , 0 ]");
+    EXPECT_EQ_INT(json[0].to_int(), 123);
+    EXPECT_EQ_INT(json[1].to_int(), -45);
+    EXPECT_EQ_STRING(json.dump(), "[123, -45, 0]");
+
+    // 超出 64 位范围时退回 double
+    json = Json::parse("18446744073709551616");
+    TEST_PARSE_JSON(json, JsonType::JSON_NUMBER, ParseCode::PARSE_OK);
+    EXPECT_EQ_DOUBLE(json.to_double(), 18446744073709551616.0);
+    json = Json::parse("-9223372036854775809");
+    EXPECT_EQ_DOUBLE(json.to_double(), -9223372036854775809.0);
+    json = Json::parse("-0");
+    EXPECT_TRUE(std::signbit(json.to_double()));
+
+    TEST_ERROR("-", ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("+1", ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("01", ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("1.", ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("1e", ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("abc", ParseCode::PARSE_INVALID_VALUE);
+}
+
+#define TEST_ROUNDTRIP_DOUBLE(value) \
+    do{ \
+        Json json = Json::parse(Json(value).dump()); \
+        EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK); \
+        EXPECT_EQ_DOUBLE(json.to_double(), value); \
+    }while(0)
+
+void test_dump_number(){
+    EXPECT_EQ_STRING(Json(0.1234567).dump(), "0.1234567");
+    EXPECT_EQ_STRING(Json(1.5).dump(), "1.5");
+    EXPECT_EQ_STRING(Json(-2.0).dump(), "-2");
+    EXPECT_EQ_STRING(Json(1e300).dump(), "1e+300");
+    EXPECT_EQ_STRING(Json(NAN).dump(), "null");
+    EXPECT_EQ_STRING(Json(-2147483647 - 1).dump(), "-2147483648");
+    EXPECT_EQ_STRING(Json(static_cast<int64_t>(INT64_MIN)).dump(), "-9223372036854775808");
+    EXPECT_EQ_STRING(Json(static_cast<uint64_t>(UINT64_MAX)).dump(), "18446744073709551615");
+
+    TEST_ROUNDTRIP_DOUBLE(0.1);
+    TEST_ROUNDTRIP_DOUBLE(0.1234567);
+    TEST_ROUNDTRIP_DOUBLE(1.0000000000000002);
+    TEST_ROUNDTRIP_DOUBLE(3.141592653589793);
+    TEST_ROUNDTRIP_DOUBLE(4.9406564584124654e-324);
+    TEST_ROUNDTRIP_DOUBLE(2.2250738585072014e-308);
+    TEST_ROUNDTRIP_DOUBLE(1.7976931348623157e+308);
+    TEST_ROUNDTRIP_DOUBLE(-1.234e-10);
+}
+
+void test_string_long(){
+    // 特殊字符落在 16/32 字节块的不同位置
+    for(size_t pos = 0; pos < 70; pos++){
+        std::string raw(70, 'a');
+        std::string text = "\"" + raw + "\"";
+        text.replace(pos + 1, 1, "\\n");
+        raw[pos] = '\n';
+        Json json = Json::parse(text);
+        EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+        EXPECT_EQ_STRING(json.to_string(), raw);
+        EXPECT_EQ_STRING(Json(raw).dump(), text);
+
+        std::string bad = "\"" + std::string(70, 'a') + "\"";
+        bad[pos + 1] = '\x01';
+        TEST_ERROR(bad, ParseCode::PARSE_INVALID_STRING_CHAR);
+        TEST_ERROR(std::string_view(bad).substr(0, pos + 1), ParseCode::PARSE_MISS_QUOTATION_MARK);
+    }
+
+    std::string utf8 = std::string(40, 'x') + "\xE2\x80\xA8" + std::string(40, 'y') + "\xE2\x82\xAC\x1F\xE2\x80";
+    EXPECT_EQ_STRING(Json(utf8).dump(),
+        "\"" + std::string(40, 'x') + "\\u2028" + std::string(40, 'y') + "\xE2\x82\xAC\\u001f\xE2\x80\"");
+    Json json = Json::parse(Json(utf8).dump());
+    EXPECT_EQ_STRING(json.to_string(), utf8);
+}
+
 void test_parse_invalid(){
     TEST_ERROR("\"", ParseCode::PARSE_MISS_QUOTATION_MARK);
     TEST_ERROR("\"abc", ParseCode::PARSE_MISS_QUOTATION_MARK);
@@ -182,6 +373,430 @@ void test_parse_invalid(){
     TEST_ERROR("\"\\uD800\\uE000\"", ParseCode::PARSE_INVALID_UNICODE_SURROGATE);
 }
 
+void test_parse_buffer(){
+    // 缓冲区不以 '\0' 结尾, 解析必须以长度为边界
+    const char buf[] = { '[', '1', ',', ' ', '"', 'a', 'b', '"', ']', '1', '2' };
+    Json json = Json::parse(buf, 9);
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(json.size(), 2);
+    EXPECT_EQ_INT(json[0].to_int(), 1);
+    EXPECT_EQ_STRING(json[1].to_string(), "ab");
+
+    TEST_ERROR(std::string_view(buf, 7), ParseCode::PARSE_MISS_QUOTATION_MARK);
+    TEST_ERROR(std::string_view(buf + 9, 1), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(Json::parse(std::string_view(buf + 9, 1)).to_int(), 1);
+    TEST_ERROR(std::string_view("\"a\0b\"", 5), ParseCode::PARSE_INVALID_STRING_CHAR);
+    TEST_ERROR(std::string("tru"), ParseCode::PARSE_INVALID_VALUE);
+    TEST_ERROR("{\"a\":1,}", ParseCode::PARSE_MISS_KEY);
+}
+
+void test_parse_arena(){
+    Arena arena(1024);
+    {
+        Json json = Json::parse("{ \"a\" : [ null , true , 1.5 , \"abc\" ] , \"b\" : { } }", arena);
+        EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+        EXPECT_EQ_INT(json.type(), JsonType::JSON_OBJECT);
+        EXPECT_EQ_INT(json["a"].size(), 4);
+        EXPECT_EQ_INT(json["a"][0].type(), JsonType::JSON_NULL);
+        EXPECT_TRUE(json["a"][1].to_bool());
+        EXPECT_EQ_DOUBLE(json["a"][2].to_double(), 1.5);
+        EXPECT_EQ_STRING(json["a"][3].to_string(), "abc");
+        EXPECT_EQ_INT(json["b"].type(), JsonType::JSON_OBJECT);
+        EXPECT_TRUE(arena.blockCount() > 0);
+        EXPECT_TRUE(arena.bytesUsed() > 0);
+
+        Json error = Json::parse("[1, ", arena);
+        EXPECT_EQ_INT(error.getErrorCode(), ParseCode::PARSE_EXPECT_VALUE);
+    }
+    arena.release();
+    EXPECT_EQ_SIZE_T(0, arena.blockCount());
+}
+
+// 统计分配次数的 memory_resource, 内存来自全局分配器
+class CountingResource : public std::pmr::memory_resource{
+  public:
+    size_t allocations = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t align) override{
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override{
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override{
+        return this == &other;
+    }
+};
+
+void test_parse_resource(){
+    // 节点, 容器, 对象条目和解析时的工作栈都来自请求级的内存池, 不再走全局分配器
+    alignas(std::max_align_t) static char buffer[64 * 1024];
+    std::pmr::monotonic_buffer_resource pool(buffer, sizeof buffer);
+    const std::string text = "{ \"a\" : [ null , true , 1.5 , \"abc\" , [ 1 , 2 ] ] , \"b\" : { \"c\" : \"d\" } }";
+    for(int ordered = 0; ordered < 2; ordered++){
+        ParseOptions options;
+        options.resource = &pool;
+        options.preserveOrder = ordered != 0;
+        size_t before = alloc_count;
+        {
+            Json json = Json::parse(text, options);
+            EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+            EXPECT_EQ_SIZE_T(5, json["a"].size());
+            EXPECT_EQ_STRING(json["b"]["c"].to_string(), "d");
+            EXPECT_TRUE(json["a"].to_array().get_allocator().resource() == &pool);
+        }
+        EXPECT_EQ_SIZE_T(0, alloc_count - before);
+    }
+
+    // 超过 SSO 的字符串, 超过内联容量的键和转义字符串的解码缓冲区同样来自内存池
+    const std::string longKey(40, 'k');
+    const std::string longValue(200, 'v');
+    const std::string escaped = "a\n" + longValue;
+    const std::string strings = "{\"" + longKey + "\": \"" + longValue + "\", \"e\": \"a\\n" + longValue
+                              + "\", \"list\": [\"" + longValue + "\", {\"" + longKey + "\": 1}]}";
+    for(int ordered = 0; ordered < 2; ordered++){
+        ParseOptions options;
+        options.resource = &pool;
+        options.preserveOrder = ordered != 0;
+        size_t before = alloc_count;
+        {
+            Json json = Json::parse(strings, options);
+            EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+            EXPECT_TRUE(json[longKey].to_string_view() == longValue);
+            EXPECT_TRUE(json["e"].to_string_view() == escaped);
+            EXPECT_TRUE(json["list"][0].to_string_view() == longValue);
+            EXPECT_EQ_INT(1, json["list"][1][longKey].to_int());
+        }
+        EXPECT_EQ_SIZE_T(0, alloc_count - before);
+    }
+
+    // 复制出的容器使用默认分配器, 子节点仍然共享, 所以同样不能比内存池活得更久
+    ParseOptions options;
+    options.resource = &pool;
+    Json json = Json::parse(text, options);
+    Json::array copy = json["a"].to_array();
+    EXPECT_TRUE(copy.get_allocator().resource() == std::pmr::get_default_resource());
+
+    // Arena 的内存块也可以来自上游的 memory_resource
+    std::pmr::monotonic_buffer_resource upstream;
+    Arena arena(1024, &upstream);
+    {
+        Json json = Json::parse(text, arena);
+        EXPECT_EQ_STRING(json.dump(), std::string("{\"a\": [null, true, 1.5, \"abc\", [1, 2]], \"b\": {\"c\": \"d\"}}"));
+        EXPECT_TRUE(json["a"].to_array().get_allocator().resource() == &arena);
+    }
+    EXPECT_TRUE(arena.blockCount() > 0);
+}
+
+// 把事件记录成字符串, limit 个事件之后停止解析
+class RecordHandler : public JsonHandler{
+  public:
+    explicit RecordHandler(int limit = -1) : limit(limit){}
+
+    bool on_null() override { return record("null"); }
+    bool on_bool(bool value) override { return record(value ? "true" : "false"); }
+    bool on_number(double value) override { return record("d:" + Json(value).dump()); }
+    bool on_int64(int64_t value) override { return record("i:" + Json(value).dump()); }
+    bool on_string(std::string_view value) override { return record("s:" + std::string(value)); }
+    bool on_key(std::string_view key) override { return record("k:" + std::string(key)); }
+    bool on_start_object() override { return record("{"); }
+    bool on_end_object() override { return record("}"); }
+    bool on_start_array() override { return record("["); }
+    bool on_end_array() override { return record("]"); }
+
+    std::string events;
+    int limit;
+
+  private:
+    bool record(const std::string& event){
+        events += event + " ";
+        return --limit != 0;
+    }
+};
+
+void test_parse_lazy(){
+    ParseOptions lazy;
+    lazy.lazy = true;
+    const std::string text = "{ \"a\" : [ null , true , -1 , 1.5 , \"a\\nb\" , [ ] , { \"x\" : [ 1 ] } ] , "
+                             "\"b\" : { \"c\" : { } , \"d\" : 2 } , \"e\" : [ [ [ 3 ] ] ] }";
+    Json json = Json::parse(text, lazy);
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(json.type(), JsonType::JSON_OBJECT);
+    EXPECT_EQ_INT(json["a"].type(), JsonType::JSON_ARRAY);
+    EXPECT_EQ_INT(json["a"].size(), 7);
+    EXPECT_EQ_INT(json["a"][2].to_int(), -1);
+    EXPECT_EQ_STRING(json["a"][4].to_string(), std::string("a\nb"));
+    EXPECT_EQ_INT(json["a"][6]["x"][0].to_int(), 1);
+    EXPECT_EQ_INT(json["b"]["d"].to_int(), 2);
+    EXPECT_EQ_INT(json["e"][0][0][0].to_int(), 3);
+    EXPECT_EQ_STRING(json.dump(), Json::parse(text).dump());
+
+    // 错误码与立即解析一致
+    const char* invalid[] = { "[1, ", "{\"a\":[1,2}", "[1e999]", "[\"\\x\"]", "{} x", "[1,{\"a\" 1}]", "1e999", "" };
+    for(const char* s : invalid){
+        EXPECT_EQ_INT(Json::parse(s, lazy).getErrorCode(), Json::parse(s).getErrorCode());
+        EXPECT_EQ_STRING(Json::parse(s, lazy).dump(), Json::parse(s).dump());
+    }
+
+    // 校验失败时直接返回错误码, 不再构建节点
+    std::string broken = "[";
+    for(int i = 0; i < 1000; i++)
+        broken += "\"" + std::string(40, 'x') + "\",";
+    size_t brokenBefore = alloc_count;
+    EXPECT_EQ_INT(Json::parse(broken, lazy).getErrorCode(), ParseCode::PARSE_EXPECT_VALUE);
+    EXPECT_TRUE(alloc_count - brokenBefore < 32);
+    EXPECT_EQ_DOUBLE(Json::parse("1.5", lazy).to_double(), 1.5);
+
+    // 解析只分配位置索引; 访问时只为被展开容器的直接子容器各分配一个节点,
+    // 未访问的子树不分配内存
+    std::string big = "[{\"id\":0,\"v\":[1,2,3]}";
+    for(int i = 1; i < 1000; i++)
+        big += ",{\"id\":" + std::to_string(i) + ",\"v\":[1,2,3]}";
+    big += "]";
+    size_t before = alloc_count;
+    json = Json::parse(big, lazy);
+    size_t parsed = alloc_count - before;
+    EXPECT_TRUE(parsed < 32);
+    before = alloc_count;
+    EXPECT_EQ_INT(json[500]["id"].to_int(), 500);
+    EXPECT_TRUE(alloc_count - before < 1000 + 32);
+    EXPECT_EQ_INT(json.size(), 1000);
+
+    // 两个线程同时读取不同的子树. 展开时不使用 keyPool 和 resource, 它们都不是线程安全的
+    const std::string key = "a_rather_long_key_name_here_xx";
+    std::string rows = "[";
+    for(int i = 0; i < 100; i++)
+        rows += (i ? ",{\"" : "{\"") + key + "\":" + std::to_string(i) + "}";
+    rows += "]";
+    KeyPool keys;
+    CountingResource counting;
+    ParseOptions shared = lazy;
+    shared.keyPool = &keys;
+    shared.resource = &counting;
+    json = Json::parse(rows, shared);
+    const size_t rootAllocations = counting.allocations;
+    int sums[2] = { 0, 0 };
+    std::vector<std::thread> readers;
+    for(int t = 0; t < 2; t++)
+        readers.emplace_back([&, t]{
+            for(int i = t; i < 100; i += 2)
+                sums[t] += json[i][key].to_int();
+        });
+    for(std::thread& reader : readers)
+        reader.join();
+    EXPECT_EQ_INT(4950, sums[0] + sums[1]);
+    EXPECT_EQ_SIZE_T(0, keys.size());
+    EXPECT_EQ_SIZE_T(rootAllocations, counting.allocations);
+}
+
+void test_parse_file(){
+    const std::string path = "spark_json_test.json";
+    const std::string text = "{ \"a\" : [ 1, 2, { \"b\" : \"file\" } ] }";
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+
+    {
+        MappedFile mapped(path);
+        EXPECT_TRUE(mapped.ok());
+        EXPECT_EQ_STRING(text, std::string(mapped.view()));
+    }
+    Json json = Json::parse_file(path);
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    EXPECT_EQ_STRING(json.dump(), Json::parse(text).dump());
+
+    // 惰性解析的 Json 持有映射, 文件内容在访问时仍然有效
+    ParseOptions lazy;
+    lazy.lazy = true;
+    json = Json::parse_file(path, lazy);
+    remove(path.c_str());
+    EXPECT_EQ_STRING(json["a"][2]["b"].to_string(), std::string("file"));
+
+    json = Json::parse_file(path);
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_FILE_ERROR);
+    EXPECT_EQ_INT(json.type(), JsonType::JSON_NULL);
+    EXPECT_FALSE(MappedFile(path).ok());
+
+#ifdef __linux__
+    // 大小未知的特殊文件改为读入缓冲区
+    MappedFile proc("/proc/self/stat");
+    EXPECT_TRUE(proc.ok());
+    EXPECT_FALSE(proc.mapped());
+    EXPECT_TRUE(proc.view().size() > 0);
+#endif
+}
+
+void test_parse_sax(){
+    RecordHandler handler;
+    ParseCode code = Json::parse("{ \"a\" : [ null , true , 1 , 1.5 , \"x\\ty\" ] , \"b\" : { } }", handler);
+    EXPECT_EQ_INT(code, ParseCode::PARSE_OK);
+    EXPECT_EQ_STRING(handler.events, std::string("{ k:a [ null true i:1 d:1.5 s:x\ty ] k:b { } } "));
+
+    // handler 返回 false 时立即停止
+    RecordHandler stopper(3);
+    code = Json::parse("[ 1 , 2 , 3 , 4 ]", stopper);
+    EXPECT_EQ_INT(code, ParseCode::PARSE_CANCELLED);
+    EXPECT_EQ_STRING(stopper.events, std::string("[ i:1 i:2 "));
+
+    // 语法错误照常报告, 只保留出错之前的事件
+    RecordHandler broken;
+    code = Json::parse("[ 1 , ", broken);
+    EXPECT_EQ_INT(code, ParseCode::PARSE_EXPECT_VALUE);
+    EXPECT_EQ_STRING(broken.events, std::string("[ i:1 "));
+
+    JsonHandler ignore;
+    EXPECT_EQ_INT(Json::parse("{ \"a\" : 1 } x", ignore), ParseCode::PARSE_ROOT_NOT_SINGULAR);
+}
+
+// 按 chunk 字节分片喂给 StreamParser, 结果必须与 Json::parse 相同
+static void test_stream_case(const std::string& text, size_t chunk){
+    StreamParser parser;
+    for(size_t i = 0; i < text.size(); i += chunk)
+        parser.feed(text.data() + i, std::min(chunk, text.size() - i));
+    Json json = parser.finish();
+    Json expect = Json::parse(text);
+    EXPECT_EQ_INT(expect.getErrorCode(), json.getErrorCode());
+    EXPECT_EQ_INT(expect.type(), json.type());
+    EXPECT_EQ_STRING(expect.dump(), json.dump());
+}
+
+void test_parse_stream(){
+    const char* cases[] = {
+        "", "  ", "null", " true ", "false", "nul", "nulx", "truex", "[1,]", "[1 2]", "[",
+        "0", "-0", "-", "01", "1.", "1.5.2", "1e", "1e+", "1E-10", "-1.234e+10", "1-2", "123456789012345678901234",
+        "1e309", "[1e309]", "18446744073709551615", "-9223372036854775808",
+        "\"\"", "\"abc", "\"a\\", "\"\\u00A2\\uD834\\uDD1E\"", "\"\\uD800\\\"\"", "\"\\u12\"", "\"\\x\"",
+        "\"a\x01b\"", "\"\\\"\\\\\"",
+        "{}", "{", "{,}", "{\"a\"}", "{\"a\" 1}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1 \"b\"}", "{\"a\":1",
+        "[ [ ] , [ 0 ] , { \"k\" : [ null , \"v\\n\" ] } ] ", "{ \"a\" : { \"b\" : [ 1.5 , -2 , true ] } } x",
+        "{\"dup\":1,\"dup\":2}"
+    };
+    for(const char* text : cases)
+        for(size_t chunk = 1; chunk <= 5; chunk++)
+            test_stream_case(text, chunk);
+
+    std::string long_text = "[\"" + std::string(100, 'x') + "\\n" + std::string(50, 'y') + "\", 12345.678, {\"key\": \"value\"}]";
+    for(size_t chunk : { 1, 7, 16, 33, 1000 })
+        test_stream_case(long_text, chunk);
+
+    // 同一个对象可以连续解析多个文档
+    StreamParser parser;
+    EXPECT_EQ_INT(parser.feed("[1, 2"), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(parser.feed("]"), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(parser.finish().size(), 2);
+    EXPECT_EQ_INT(parser.feed("{]"), ParseCode::PARSE_MISS_KEY);
+    EXPECT_EQ_INT(parser.finish().getErrorCode(), ParseCode::PARSE_MISS_KEY);
+    parser.feed("\"ok\"");
+    EXPECT_EQ_STRING(parser.finish().to_string(), "ok");
+}
+
+void test_ndjson(){
+    std::string text;
+    for(int i = 0; i < 500; i++){
+        text += "{\"n\":" + std::to_string(i) + "}";
+        text += i % 7 == 0 ? "\r\n" : i % 11 == 0 ? "\n  \n" : "\n";
+    }
+    text += "[1, ";     // 最后一行出错且没有换行
+    size_t lines = std::count(text.begin(), text.end(), '\n') + 1;
+
+    for(int ordered = 0; ordered < 2; ordered++){
+        NdjsonOptions options;
+        options.threads = 4;
+        options.chunkSize = 64;
+        options.ordered = ordered != 0;
+        NdjsonReader reader(options);
+        std::vector<std::pair<size_t, Json>> docs;
+        EXPECT_EQ_INT(reader.parse(text, [&](size_t line, Json&& json){
+            docs.emplace_back(line, std::move(json));
+            return true;
+        }), ParseCode::PARSE_OK);
+        EXPECT_EQ_SIZE_T(501, docs.size());
+        if(!ordered)
+            std::sort(docs.begin(), docs.end(), [](const std::pair<size_t, Json>& a, const std::pair<size_t, Json>& b){
+                return a.first < b.first;
+            });
+        bool ok = true;
+        for(size_t i = 0; i < 500; i++)
+            ok = ok && docs[i].second["n"].to_int() == static_cast<int>(i) && docs[i].first < docs[i + 1].first;
+        EXPECT_TRUE(ok);
+        EXPECT_EQ_SIZE_T(lines - 1, docs.back().first);
+        EXPECT_EQ_INT(docs.back().second.getErrorCode(), ParseCode::PARSE_EXPECT_VALUE);
+    }
+
+    // 回调返回 false 时停止
+    NdjsonOptions options;
+    options.chunkSize = 32;
+    NdjsonReader reader(options);
+    size_t delivered = 0;
+    EXPECT_EQ_INT(reader.parse(text, [&](size_t, Json&&){ return ++delivered < 10; }), ParseCode::PARSE_CANCELLED);
+    EXPECT_EQ_SIZE_T(10, delivered);
+    EXPECT_EQ_INT(reader.parse("", [&](size_t, Json&&){ return false; }), ParseCode::PARSE_OK);
+
+    // 多个工作线程不能共用一个 memory_resource, resource 被忽略
+    CountingResource counting;
+    NdjsonOptions shared;
+    shared.threads = 4;
+    shared.chunkSize = 64;
+    shared.parse.resource = &counting;
+    size_t parsed = 0;
+    EXPECT_EQ_INT(NdjsonReader(shared).parse(text, [&](size_t, Json&& json){
+        parsed += json.getErrorCode() == ParseCode::PARSE_OK;
+        return true;
+    }), ParseCode::PARSE_OK);
+    EXPECT_EQ_SIZE_T(500, parsed);
+    EXPECT_EQ_SIZE_T(0, counting.allocations);
+
+    // SAX: 每个线程一个 handler, 返回行号最小的错误
+    RecordHandler a, b, c;
+    std::vector<JsonHandler*> handlers = { &a, &b, &c };
+    EXPECT_EQ_INT(reader.parse("1\n[2]\n{\"x\":3}\n4 5\n6\n\"", handlers), ParseCode::PARSE_ROOT_NOT_SINGULAR);
+    EXPECT_EQ_INT(reader.parse(text.substr(0, text.size() - 4), handlers), ParseCode::PARSE_OK);
+    size_t objects = 0;
+    for(const RecordHandler* h : { &a, &b, &c })
+        objects += std::count(h->events.begin(), h->events.end(), '{');
+    EXPECT_EQ_SIZE_T(1 + 500, objects);
+
+    // 空回调和空 handler 不解析
+    EXPECT_EQ_INT(reader.parse(text, NdjsonReader::Callback()), ParseCode::PARSE_INVALID_ARGUMENT);
+    EXPECT_EQ_INT(reader.parse(text, std::vector<JsonHandler*>()), ParseCode::PARSE_INVALID_ARGUMENT);
+    handlers.push_back(nullptr);
+    EXPECT_EQ_INT(reader.parse(text, handlers), ParseCode::PARSE_INVALID_ARGUMENT);
+}
+
+void test_dump_sink(){
+    Json json = Json::parse("{ \"a\" : [ 1 , 2.5 , \"x\\ny\" ] , \"b\" : { \"c\" : null } , \"long\" : \""
+                            + std::string(100, 'z') + "\" }");
+    const std::string expect = json.dump();
+
+    // 缓冲区很小, 需要多次 flush, 超长片段直接写出
+    std::string out;
+    size_t writes = 0;
+    {
+        CallbackSink sink([&](const char* data, size_t len){ out.append(data, len); writes++; }, 8);
+        json.dump(sink);
+    }
+    EXPECT_EQ_STRING(expect, out);
+    EXPECT_TRUE(writes > 1);
+
+    FILE* file = tmpfile();
+    {
+        FileSink sink(file, 16);
+        json.dump(sink);
+        sink += '\n';
+        json.dump(sink);
+        sink.flush();
+        EXPECT_FALSE(sink.error());
+    }
+    rewind(file);
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof buf, file);
+    fclose(file);
+    const std::string twice = expect + "\n" + expect;
+    EXPECT_EQ_STRING(twice, std::string(buf, len));
+}
+
 void test_array(){
     Json json = Json::parse("[ ]");
     EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
@@ -255,12 +870,558 @@ void test_object(){
     EXPECT_TRUE(json["key2"]["key3"].to_bool());
 }
 
+void test_mutation(){
+    Json json;
+    *json.mutableAt("name") = "spark";
+    json.set("tags", Json::array{ "a" });
+    json.mutableAt("tags")->push_back("b");
+    *json.mutableAt("nested")->mutableAt("deep")->mutableAt(2) = 3;
+    EXPECT_EQ_STRING(json.dump(), std::string("{\"name\": \"spark\", \"nested\": {\"deep\": [null, null, 3]}, \"tags\": [\"a\", \"b\"]}"));
+
+    // 写时复制: 修改副本不影响原文档, 未修改的子树继续共享
+    Json copy = json;
+    *copy.mutableAt("nested")->mutableAt("deep")->mutableAt(0) = true;
+    copy.set("name", 1);
+    const Json& original = json;
+    const Json& changed = copy;
+    EXPECT_TRUE(original["nested"]["deep"][0].type() == JsonType::JSON_NULL);
+    EXPECT_EQ_STRING(original["name"].to_string(), std::string("spark"));
+    EXPECT_TRUE(changed["nested"]["deep"][0].to_bool());
+    EXPECT_TRUE(&original["tags"].to_array() == &changed["tags"].to_array());
+    EXPECT_FALSE(&original["nested"].to_object() == &changed["nested"].to_object());
+
+    EXPECT_EQ_SIZE_T(1, copy.erase("name"));
+    EXPECT_EQ_SIZE_T(0, copy.erase("name"));
+    EXPECT_TRUE(copy.mutableAt("tags")->erase(0));
+    EXPECT_FALSE(copy.mutableAt("tags")->erase(5));
+    EXPECT_EQ_STRING(copy.dump(), std::string("{\"nested\": {\"deep\": [true, null, 3]}, \"tags\": [\"b\"]}"));
+    EXPECT_EQ_SIZE_T(2, original["tags"].size());
+
+    // 独占的节点原地修改, 不再复制
+    const Json::array* before = &copy["tags"].to_array();
+    copy.mutableAt("tags")->push_back(1);
+    EXPECT_TRUE(before == &copy["tags"].to_array());
+
+    // 空容器单例和惰性节点在修改前先复制
+    Json empty = Json::parse("[]");
+    empty.push_back(1);
+    EXPECT_EQ_STRING(Json::parse("[]").dump(), std::string("[]"));
+    ParseOptions lazy;
+    lazy.lazy = true;
+    const std::string text = "{\"a\": {\"b\": [1]}}";
+    Json doc = Json::parse(text, lazy);
+    doc.mutableAt("a")->mutableAt("b")->push_back(2);
+    EXPECT_EQ_STRING(doc.dump(), std::string("{\"a\": {\"b\": [1, 2]}}"));
+
+    // 保持插入顺序的对象: 新键追加在末尾, 已有的键原地修改
+    ParseOptions ordered;
+    ordered.preserveOrder = true;
+    Json keep = Json::parse("{\"b\": 1, \"a\": 2}", ordered);
+    *keep.mutableAt("c") = 3;
+    *keep.mutableAt("a") = 4;
+    EXPECT_EQ_STRING(keep.dump(), std::string("{\"b\": 1, \"a\": 4, \"c\": 3}"));
+    EXPECT_EQ_INT(3, keep["c"].to_int());
+
+    // 类型不符时不修改, mutableAt 返回 nullptr
+    Json number = 1;
+    EXPECT_FALSE(number.push_back(2));
+    EXPECT_FALSE(number.set("x", 2));
+    EXPECT_TRUE(number.mutableAt("x") == nullptr);
+    EXPECT_TRUE(number.mutableAt(3) == nullptr);
+    EXPECT_EQ_STRING(number.dump(), std::string("1"));
+    EXPECT_EQ_SIZE_T(0, number.erase("x"));
+    Json list = Json::parse("[1,2,3]");
+    EXPECT_TRUE(list.mutableAt("id") == nullptr);
+    EXPECT_FALSE(list.set("id", 1));
+    EXPECT_TRUE(list.mutableAt(1) != nullptr && list.mutableAt(1)->to_int() == 2);
+    EXPECT_EQ_STRING(list.dump(), std::string("[1, 2, 3]"));
+
+    // 下标读取不修改文档: 类型不符, 越界和不存在的键都返回 null
+    Json object = Json::parse("{\"a\": 1}");
+    Json str = Json::parse("\"abc\"");
+    EXPECT_TRUE(list["id"].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(list[3].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(list[100].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(object[5].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(object["b"].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(str[0].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(str["a"].type() == JsonType::JSON_NULL);
+    EXPECT_TRUE(number[0].type() == JsonType::JSON_NULL);
+    EXPECT_EQ_STRING(list.dump(), std::string("[1, 2, 3]"));
+    EXPECT_EQ_STRING(object.dump(), std::string("{\"a\": 1}"));
+    EXPECT_EQ_STRING(str.dump(), std::string("\"abc\""));
+    EXPECT_EQ_SIZE_T(3, list.size());
+    EXPECT_EQ_SIZE_T(1, object.size());
+}
+
+void test_stats(){
+    const std::string text = "{\"name\": \"spark\", \"tags\": [\"a\", 1, 2.5, true, null], \"nested\": {\"deep\": []}}";
+    JsonStats stats;
+    ParseOptions options;
+    options.stats = &stats;
+    Json json = Json::parse(text, options);
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    std::string out;
+    JsonStats dumpStats;
+    json.dump(out, dumpStats);
+    EXPECT_EQ_STRING(out, json.dump());
+
+    if(!JsonStats::enabled){
+        // 未开启时不收集, 传入的结构保持为 0
+        EXPECT_EQ_SIZE_T(0, stats.nodes[JSON_OBJECT]);
+        EXPECT_EQ_SIZE_T(0, stats.parseNanos);
+        EXPECT_EQ_SIZE_T(0, dumpStats.outputBytes);
+        return;
+    }
+    EXPECT_EQ_SIZE_T(2, stats.nodes[JSON_OBJECT]);
+    EXPECT_EQ_SIZE_T(2, stats.nodes[JSON_ARRAY]);
+    EXPECT_EQ_SIZE_T(2, stats.nodes[JSON_STRING]);
+    EXPECT_EQ_SIZE_T(2, stats.nodes[JSON_NUMBER]);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[JSON_BOOL]);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[JSON_NULL]);
+    // 值 "spark" "a" 加上键 name tags nested deep
+    EXPECT_EQ_SIZE_T(6 + 4 + 4 + 6 + 4, stats.stringBytes);
+    EXPECT_EQ_SIZE_T(3, stats.maxDepth);
+    EXPECT_TRUE(stats.allocations > 0);
+    EXPECT_TRUE(stats.parseNanos > 0);
+    EXPECT_TRUE(stats.parseNanos >= stats.stringNanos + stats.numberNanos);
+
+    EXPECT_EQ_SIZE_T(out.size(), dumpStats.outputBytes);
+    EXPECT_EQ_SIZE_T(2, dumpStats.nodes[JSON_OBJECT]);
+    EXPECT_EQ_SIZE_T(1, dumpStats.nodes[JSON_NULL]);
+    EXPECT_EQ_SIZE_T(stats.stringBytes, dumpStats.stringBytes);
+    EXPECT_EQ_SIZE_T(3, dumpStats.maxDepth);
+    EXPECT_TRUE(dumpStats.dumpNanos > 0);
+
+    // 结果在多次调用之间累加
+    Json::parse(text, options);
+    EXPECT_EQ_SIZE_T(4, stats.nodes[JSON_OBJECT]);
+}
+
+void test_object_map(){
+    // 默认按键排序, 重复的键保留最后一个值
+    Json json = Json::parse("{ \"b\" : 1 , \"a\" : 2 , \"c\" : 3 , \"a\" : 4 }");
+    EXPECT_EQ_INT(json.size(), 3);
+    EXPECT_EQ_STRING(json.dump(), std::string("{\"a\": 4, \"b\": 1, \"c\": 3}"));
+
+    ParseOptions options;
+    options.preserveOrder = true;
+    json = Json::parse("{ \"b\" : 1 , \"a\" : 2 , \"c\" : 3 , \"a\" : 4 }", options);
+    EXPECT_EQ_INT(json.size(), 3);
+    EXPECT_EQ_STRING(json.dump(), std::string("{\"b\": 1, \"a\": 4, \"c\": 3}"));
+    EXPECT_TRUE(json.to_object().preserveOrder());
+
+    // 迭代器只读, 键不能被改写; 值通过 operator[] 修改
+    static_assert(std::is_const<std::remove_reference<decltype(*std::declval<Json::object&>().begin())>::type>::value,
+                  "FlatMap iterators must not expose mutable keys");
+
+    StreamParser stream(options);
+    stream.feed("{\"z\":1,\"y\":2}");
+    EXPECT_EQ_STRING(stream.finish().dump(), std::string("{\"z\": 1, \"y\": 2}"));
+
+    // 超过线性查找上限后走二分查找
+    for(int ordered = 0; ordered < 2; ordered++){
+        Json::object obj(ordered != 0);
+        for(int i = 99; i >= 0; i--)
+            obj["key" + std::to_string(i)] = i;
+        EXPECT_EQ_SIZE_T(100, obj.size());
+        EXPECT_EQ_STRING(obj.begin()->first, std::string(ordered ? "key99" : "key0"));
+        EXPECT_EQ_SIZE_T(1, obj.erase("key50"));
+        EXPECT_EQ_SIZE_T(0, obj.erase("key50"));
+        EXPECT_EQ_SIZE_T(0, obj.erase("missing"));
+        json = std::move(obj);
+        bool ok = true;
+        for(int i = 0; i < 100; i++){
+            const Json& v = json["key" + std::to_string(i)];
+            if(i == 50)
+                ok = ok && v.type() == JsonType::JSON_NULL;
+            else
+                ok = ok && v.to_int() == i;
+        }
+        EXPECT_TRUE(ok);
+        EXPECT_EQ_SIZE_T(0, json.to_object().count("key"));
+        EXPECT_EQ_SIZE_T(1, json.to_object().count("key7"));
+    }
+
+    Json::object small = { { "x", 1 }, { "y", 2 }, { "x", 3 } };
+    EXPECT_EQ_SIZE_T(2, small.size());
+    EXPECT_EQ_INT(small["x"].to_int(), 1);
+}
+
+void test_key_pool(){
+    // 短键内联存放, 长键共享引用计数的存储
+    const std::string longKey(40, 'k');
+    JsonKey inlined("id");
+    JsonKey heap(longKey);
+    JsonKey copy = heap;
+    EXPECT_EQ_STRING(inlined, std::string("id"));
+    EXPECT_EQ_STRING(copy, longKey);
+    EXPECT_TRUE(copy.sameStorage(heap));
+    EXPECT_FALSE(JsonKey(longKey).sameStorage(heap));
+    EXPECT_TRUE(JsonKey(longKey) == heap);
+    EXPECT_TRUE(JsonKey("a") < JsonKey("b"));
+
+    KeyPool pool;
+    EXPECT_TRUE(pool.intern(longKey).sameStorage(pool.intern(longKey)));
+    EXPECT_EQ_SIZE_T(1, pool.size());
+    pool.intern("id");
+    EXPECT_EQ_SIZE_T(1, pool.size());
+
+    // 同一数组中各行的长键共享一份存储, 且不依赖 pool 的生命周期
+    const std::string row = "{\"" + longKey + "\":1,\"id\":2}";
+    ParseOptions options;
+    options.keyPool = &pool;
+    Json json = Json::parse("[" + row + "," + row + "]", options);
+    pool.clear();
+    EXPECT_EQ_INT(json.getErrorCode(), ParseCode::PARSE_OK);
+    const Json::object& a = json[0].to_object();
+    const Json::object& b = json[1].to_object();
+    EXPECT_TRUE(a.find(longKey)->first.sameStorage(b.find(longKey)->first));
+    EXPECT_FALSE(a.find(longKey)->first.sameStorage(heap));
+    EXPECT_EQ_INT(json[1][longKey].to_int(), 1);
+    EXPECT_EQ_INT(json[1]["id"].to_int(), 2);
+    EXPECT_EQ_STRING(json.dump(), "[" + std::string("{\"id\": 2, \"") + longKey + "\": 1}, {\"id\": 2, \"" + longKey + "\": 1}]");
+
+    StreamParser stream(options);
+    stream.feed("[" + row + ",");
+    stream.feed(row + "]");
+    json = stream.finish();
+    EXPECT_TRUE(json[0].to_object().find(longKey)->first.sameStorage(json[1].to_object().find(longKey)->first));
+}
+
+void test_json_pointer(){
+    Json json = Json::parse("{ \"a\" : { \"b\" : [ 0, 1, 2, { \"c\" : \"deep\" } ] }, "
+                            "\"m~n\" : 1, \"x/y\" : 2, \"\" : 3, \"07\" : 4 }");
+    EXPECT_EQ_STRING(json.at(JsonPointer("/a/b/3/c")).to_string(), std::string("deep"));
+    EXPECT_EQ_INT(json.at(JsonPointer("/a/b/2")).to_int(), 2);
+    EXPECT_EQ_INT(json.at(JsonPointer("/m~0n")).to_int(), 1);
+    EXPECT_EQ_INT(json.at(JsonPointer("/x~1y")).to_int(), 2);
+    EXPECT_EQ_INT(json.at(JsonPointer("/")).to_int(), 3);
+    EXPECT_EQ_INT(json.at(JsonPointer("/07")).to_int(), 4);
+    EXPECT_EQ_INT(json.at(JsonPointer("")).type(), JsonType::JSON_OBJECT);
+    EXPECT_EQ_INT(json.at(JsonPointer()).size(), 5);
+
+    // 不存在的路径, 前导 0 和 "-" 都不是有效下标
+    EXPECT_EQ_INT(json.at(JsonPointer("/a/b/4")).type(), JsonType::JSON_NULL);
+    EXPECT_EQ_INT(json.at(JsonPointer("/a/b/-")).type(), JsonType::JSON_NULL);
+    EXPECT_EQ_INT(json.at(JsonPointer("/a/b/01")).type(), JsonType::JSON_NULL);
+    EXPECT_EQ_INT(json.at(JsonPointer("/a/b/3/c/d")).type(), JsonType::JSON_NULL);
+    EXPECT_EQ_INT(json.at(JsonPointer("/missing")).type(), JsonType::JSON_NULL);
+
+    JsonPointer invalid("a/b");
+    EXPECT_FALSE(invalid.valid());
+    EXPECT_FALSE(JsonPointer("/a~2").valid());
+    EXPECT_FALSE(JsonPointer("/a~").valid());
+    EXPECT_EQ_INT(json.at(invalid).type(), JsonType::JSON_NULL);
+
+    // 编译一次后反复求值不分配内存
+    JsonPointer pointer("/a/b/3/c");
+    EXPECT_EQ_SIZE_T(4, pointer.size());
+    size_t before = alloc_count;
+    bool ok = true;
+    for(int i = 0; i < 100; i++)
+        ok = ok && pointer.resolve(json).to_string() == "deep";
+    EXPECT_TRUE(ok);
+    EXPECT_EQ_SIZE_T(0, alloc_count - before);
+
+    ParseOptions lazy;
+    lazy.lazy = true;
+    const std::string text = json.dump();
+    EXPECT_EQ_STRING(Json::parse(text, lazy).at(pointer).to_string(), std::string("deep"));
+}
+
+void test_extract(){
+    const std::string text = "{ \"id\" : -42, \"skip\" : { \"deep\" : [ \"]\", \"\\\"}\", [ { } ] ] }, "
+                             "\"user\" : { \"name\" : \"a\\nb\", \"score\" : 1.5, \"tags\" : [ \"x\", \"y\" ] }, "
+                             "\"ok\" : true, \"big\" : 18446744073709551615 }";
+    JsonExtractor extractor;
+    size_t id = extractor.add(JsonPointer("/id"));
+    size_t name = extractor.add(JsonPointer("/user/name"));
+    size_t score = extractor.add(JsonPointer("/user/score"));
+    size_t tag = extractor.add(JsonPointer("/user/tags/1"));
+    size_t tags = extractor.add(JsonPointer("/user/tags"));
+    size_t ok = extractor.add(JsonPointer("/ok"));
+    size_t big = extractor.add(JsonPointer("/big"));
+    size_t missing = extractor.add(JsonPointer("/user/missing"));
+    size_t invalid = extractor.add(JsonPointer("user"));
+    EXPECT_EQ_SIZE_T(id, extractor.add(JsonPointer("/id")));
+    EXPECT_EQ_SIZE_T(9, extractor.size());
+
+    EXPECT_EQ_INT(extractor.extract(text), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(extractor[id].type(), JsonType::JSON_NUMBER);
+    EXPECT_EQ_INT(extractor[id].to_int64_t(), -42);
+    EXPECT_EQ_STRING(std::string(extractor[name].to_string()), std::string("a\nb"));
+    EXPECT_EQ_DOUBLE(extractor[score].to_double(), 1.5);
+    EXPECT_EQ_STRING(std::string(extractor[tag].to_string()), std::string("y"));
+    EXPECT_EQ_INT(extractor[tags].type(), JsonType::JSON_ARRAY);
+    EXPECT_EQ_STRING(std::string(extractor[tags].raw()), std::string("[ \"x\", \"y\" ]"));
+    EXPECT_TRUE(extractor[ok].to_bool());
+    EXPECT_TRUE(extractor[big].to_uint64_t() == UINT64_MAX);
+    EXPECT_FALSE(extractor[missing].found());
+    EXPECT_FALSE(extractor[invalid].found());
+
+    // 与构建 Json 后查找的结果一致
+    Json json = Json::parse(text);
+    EXPECT_EQ_STRING(json.at(JsonPointer("/user/name")).to_string(), std::string(extractor[name].to_string()));
+
+    // 默认重复的键以先出现的为准
+    const std::string dup = "{\"a\": 1, \"o\": {\"x\": 1, \"y\": \"p\\nq\"}, \"a\": \"last\", \"o\": {\"x\": 2}, \"o2\": 3}";
+    JsonExtractor firsts;
+    size_t firstA = firsts.add(JsonPointer("/a"));
+    size_t firstY = firsts.add(JsonPointer("/o/y"));
+    EXPECT_EQ_INT(firsts.extract(dup), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(1, firsts[firstA].to_int64_t());
+    EXPECT_EQ_STRING(std::string(firsts[firstY].to_string()), std::string("p\nq"));
+
+    // lastDuplicateWins 时以最后出现的为准, 与 Json::parse 相同; 被覆盖的子树中的结果作废
+    JsonExtractor dups(true);
+    size_t a = dups.add(JsonPointer("/a"));
+    size_t ox = dups.add(JsonPointer("/o/x"));
+    size_t oy = dups.add(JsonPointer("/o/y"));
+    size_t o = dups.add(JsonPointer("/o"));
+    EXPECT_EQ_INT(dups.extract(dup), ParseCode::PARSE_OK);
+    Json dupJson = Json::parse(dup);
+    EXPECT_EQ_STRING(std::string(dups[a].to_string()), dupJson.at(JsonPointer("/a")).to_string());
+    EXPECT_EQ_INT(dups[ox].to_int64_t(), dupJson.at(JsonPointer("/o/x")).to_int64_t());
+    EXPECT_FALSE(dups[oy].found());
+    EXPECT_EQ_INT(dupJson.at(JsonPointer("/o/y")).type(), JsonType::JSON_NULL);
+    EXPECT_EQ_STRING(std::string(dups[o].raw()), std::string("{\"x\": 2}"));
+
+    // 找到所有路径后立即停止, 不检查后面的内容
+    JsonExtractor early;
+    size_t first = early.add(JsonPointer("/a"));
+    EXPECT_EQ_INT(early.extract("{\"a\": 1, \"b\": ["), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(early[first].to_int64_t(), 1);
+
+    // lastDuplicateWins 时后面可能还有重复的键, 所以仍然检查完整个输入
+    JsonExtractor strict(true);
+    size_t strictA = strict.add(JsonPointer("/a"));
+    EXPECT_TRUE(strict.extract("{\"a\": 1, \"b\": [") != ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(strict.extract("{\"a\": 1, \"b\": [1]}"), ParseCode::PARSE_OK);
+    EXPECT_EQ_INT(strict[strictA].to_int64_t(), 1);
+    EXPECT_EQ_INT(early.extract("{\"b\": [1, 2"), ParseCode::PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ_INT(early.extract("{\"b\": \"unterminated"), ParseCode::PARSE_MISS_QUOTATION_MARK);
+    EXPECT_EQ_INT(early.extract("{\"b\": 1} x"), ParseCode::PARSE_ROOT_NOT_SINGULAR);
+    EXPECT_FALSE(early[first].found());
+
+    // 没有转义的字符串直接指向输入, 反复提取不分配内存
+    size_t before = alloc_count;
+    bool same = true;
+    for(int i = 0; i < 10; i++)
+        same = same && extractor.extract(text) == ParseCode::PARSE_OK && extractor[tag].to_string() == "y";
+    EXPECT_TRUE(same);
+    EXPECT_EQ_SIZE_T(0, alloc_count - before);
+}
+
+void test_msgpack(){
+    std::string out;
+    Json(Json::array{ 1, -1, nullptr, true, "ab" }).dump_msgpack(out);
+    EXPECT_EQ_STRING(out, std::string("\x95\x01\xff\xc0\xc3\xa2" "ab", 8));
+
+    // 三种整数宽度分别编码, 解码后再次编码得到相同的字节
+    Json::object obj{
+        { "int", 5 }, { "neg", -200 }, { "big", 70000 },
+        { "int64", static_cast<int64_t>(5) }, { "uint64", static_cast<uint64_t>(18446744073709551615ULL) },
+        { "double", 1.5 }, { "false", false },
+        { "str31", std::string(31, 'a') }, { "str255", std::string(255, 'b') }, { "str70k", std::string(70000, 'c') },
+        { "nested", Json::array{ Json::object{ { "k", Json::array{} } }, Json::object{} } }
+    };
+    Json::array wide(70000, Json(1));
+    obj["wide"] = wide;
+    Json json(obj);
+    out.clear();
+    json.dump_msgpack(out);
+    Json decoded = Json::parse_msgpack(out);
+    EXPECT_EQ_INT(decoded.getErrorCode(), ParseCode::PARSE_OK);
+    EXPECT_EQ_STRING(decoded.dump(), json.dump());
+    std::string again;
+    decoded.dump_msgpack(again);
+    EXPECT_TRUE(again == out);
+    EXPECT_EQ_SIZE_T(18446744073709551615ULL, decoded["uint64"].to_uint64_t());
+    EXPECT_EQ_INT(decoded["neg"].to_int(), -200);
+    std::string width;
+    decoded["int64"].dump_msgpack(width);
+    EXPECT_EQ_SIZE_T(9, width.size());
+
+    // 其他编码器常用的格式: uint8/uint32/float32
+    decoded = Json::parse_msgpack(std::string("\x93\xcc\xc8\xce\xff\xff\xff\xff\xca\x3f\xc0\x00\x00", 13));
+    EXPECT_EQ_STRING(decoded.dump(), std::string("[200, 4294967295, 1.5]"));
+
+    // 选项与文本解析相同
+    ParseOptions options;
+    options.preserveOrder = true;
+    out.clear();
+    Json::parse("{\"b\": 1, \"a\": 2}", options).dump_msgpack(out);
+    EXPECT_EQ_STRING(Json::parse_msgpack(out, options).dump(), std::string("{\"b\": 1, \"a\": 2}"));
+
+    // 编码直接追加到调用者的缓冲区
+    out.clear();
+    out.reserve(1 << 20);
+    size_t before = alloc_count;
+    json.dump_msgpack(out);
+    EXPECT_EQ_SIZE_T(0, alloc_count - before);
+
+    EXPECT_EQ_INT(Json::parse_msgpack("").getErrorCode(), ParseCode::PARSE_EXPECT_VALUE);
+    EXPECT_EQ_INT(Json::parse_msgpack("\x92\x01").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xa3" "ab").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xd3\x01").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xc1").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xc4\x01" "a").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xdd\xff\xff\xff\xff").getErrorCode(), ParseCode::PARSE_INVALID_MSGPACK);
+    EXPECT_EQ_INT(Json::parse_msgpack("\x81\x01\x01").getErrorCode(), ParseCode::PARSE_MISS_KEY);
+    EXPECT_EQ_INT(Json::parse_msgpack("\xc0\xc0").getErrorCode(), ParseCode::PARSE_ROOT_NOT_SINGULAR);
+}
+
+void test_tape(){
+    const std::string text = "{\"name\": \"spark\", \"n\": [1, -2, 3000000000, 18446744073709551615, 2.5, true, false, null],"
+                             " \"nested\": {\"a\": {\"b\": [\"x\", {}]}}, \"empty\": \"\"}";
+    Json json = Json::parse(text);
+    std::string tape;
+    EXPECT_TRUE(json.dump_tape(tape));
+
+    // 缓冲区换一个地址 (不对齐) 后照样可以读取
+    std::string moved = " " + tape;
+    JsonTapeView root(std::string_view(moved).substr(1));
+    EXPECT_TRUE(root.valid());
+    EXPECT_EQ_INT(root.type(), JsonType::JSON_OBJECT);
+    EXPECT_EQ_SIZE_T(4, root.size());
+    EXPECT_TRUE(root["name"].to_string() == "spark");
+    EXPECT_TRUE(root["empty"].valid());
+    EXPECT_TRUE(root["empty"].to_string().empty());
+    EXPECT_EQ_SIZE_T(8, root["n"].size());
+    EXPECT_EQ_INT(root["n"][1].to_int(), -2);
+    EXPECT_EQ_SIZE_T(3000000000ULL, root["n"][2].to_uint64_t());
+    EXPECT_EQ_SIZE_T(18446744073709551615ULL, root["n"][3].to_uint64_t());
+    EXPECT_EQ_DOUBLE(root["n"][4].to_double(), 2.5);
+    EXPECT_EQ_INT(2, root["n"][4].to_int());
+    EXPECT_TRUE(root["n"][5].to_bool());
+    EXPECT_EQ_INT(root["n"][7].type(), JsonType::JSON_NULL);
+    EXPECT_TRUE(root["n"][7].valid());
+    EXPECT_TRUE(root.key(0) == "empty");
+    EXPECT_TRUE(root.at(JsonPointer("/nested/a/b/0")).to_string() == "x");
+    EXPECT_EQ_SIZE_T(0, root.at(JsonPointer("/nested/a/b/1")).size());
+
+    // 超出范围的浮点数取整时截断到目标类型的范围
+    std::string big;
+    EXPECT_TRUE(Json::parse("[1e300, -1e300, -1.5]").dump_tape(big));
+    JsonTapeView numbers(big);
+    EXPECT_EQ_INT(INT_MAX, numbers[0].to_int());
+    EXPECT_EQ_INT(INT_MIN, numbers[1].to_int());
+    EXPECT_TRUE(numbers[0].to_int64_t() == INT64_MAX);
+    EXPECT_EQ_SIZE_T(0, numbers[2].to_uint64_t());
+
+    // 不存在的路径
+    EXPECT_FALSE(root["missing"].valid());
+    EXPECT_FALSE(root["n"][8].valid());
+    EXPECT_FALSE(root["name"]["x"].valid());
+    EXPECT_FALSE(root.at(JsonPointer("/nested/x/b")).valid());
+
+    // 反序列化得到相同的树, 再次编码得到相同的字节
+    Json back = root.to_json();
+    EXPECT_EQ_STRING(back.dump(), json.dump());
+    std::string again;
+    back.dump_tape(again);
+    EXPECT_TRUE(again == tape);
+    EXPECT_EQ_STRING(root["nested"].to_json().dump(), std::string("{\"a\": {\"b\": [\"x\", {}]}}"));
+
+    // 保持插入顺序的对象线性查找
+    ParseOptions options;
+    options.preserveOrder = true;
+    tape.clear();
+    Json::parse("{\"b\": 1, \"a\": 2}", options).dump_tape(tape);
+    JsonTapeView ordered(tape);
+    EXPECT_TRUE(ordered.key(0) == "b");
+    EXPECT_EQ_INT(ordered["a"].to_int(), 2);
+    EXPECT_EQ_STRING(ordered.to_json().dump(), std::string("{\"b\": 1, \"a\": 2}"));
+
+    // 读取不分配内存
+    size_t before = alloc_count;
+    int sum = 0;
+    for(int i = 0; i < 10; i++)
+        sum += root["n"][1].to_int() + static_cast<int>(root["name"].to_string().size());
+    EXPECT_EQ_INT(sum, 30);
+    EXPECT_EQ_SIZE_T(0, alloc_count - before);
+
+    // 头部不合法, 以及截断的数据不会越界
+    EXPECT_FALSE(JsonTapeView("").valid());
+    EXPECT_FALSE(JsonTapeView("{}").valid());
+    tape.clear();
+    json.dump_tape(tape);
+    for(size_t len = 5; len < tape.size(); len += 7){
+        JsonTapeView cut(std::string_view(tape.data(), len));
+        cut.to_json();
+        cut.at(JsonPointer("/nested/a/b/0")).to_string();
+    }
+}
+
+static size_t count_parse_allocs(const std::string& text, const ParseOptions& options = ParseOptions()){
+    size_t before = alloc_count;
+    Json json = Json::parse(text, options);
+    return alloc_count - before;
+}
+
+void test_parse_allocs(){
+    // 超出 SSO 长度的字符串: 节点一次, 内容一次, 不再有拷贝
+    const std::string s = "\"" + std::string(40, 's') + "\"";
+    size_t one = count_parse_allocs("[" + s + "]");
+    size_t two = count_parse_allocs("[" + s + "," + s + "]");
+    EXPECT_EQ_SIZE_T(2, two - one);
+
+    // 容器: 节点一次, 元素缓冲区一次 (元素个数已知, 一次分配到位)
+    size_t arrays = count_parse_allocs("[[1,2,3],[4,5,6,7,8,9,10]]");
+    size_t array = count_parse_allocs("[[1,2,3]]");
+    EXPECT_EQ_SIZE_T(2, arrays - array);
+
+    // 对象: 节点一次, 条目缓冲区一次; 长键一次, 值字符串两次
+    const std::string obj = "{\"" + std::string(32, 'k') + "\":" + s + "}";
+    size_t objects = count_parse_allocs("[" + obj + "," + obj + "]");
+    size_t object = count_parse_allocs("[" + obj + "]");
+    EXPECT_EQ_SIZE_T(5, objects - object);
+
+    ParseOptions options;
+    options.preserveOrder = true;
+    objects = count_parse_allocs("[" + obj + "," + obj + "]", options);
+    object = count_parse_allocs("[" + obj + "]", options);
+    EXPECT_EQ_SIZE_T(6, objects - object);  // 加上按键排序的下标
+
+    // 驻留后相同的长键不再分配
+    KeyPool pool;
+    ParseOptions interned;
+    interned.keyPool = &pool;
+    count_parse_allocs("[" + obj + "]", interned);
+    objects = count_parse_allocs("[" + obj + "," + obj + "]", interned);
+    object = count_parse_allocs("[" + obj + "]", interned);
+    EXPECT_EQ_SIZE_T(4, objects - object);
+}
+
 int main(){
     test_construct();
+    test_scalar();
     test_parse();
+    test_parse_integer();
+    test_dump_number();
+    test_string_long();
     test_parse_invalid();
+    test_parse_buffer();
+    test_parse_arena();
+    test_parse_resource();
+    test_parse_lazy();
+    test_parse_file();
+    test_parse_sax();
+    test_parse_stream();
+    test_ndjson();
+    test_dump_sink();
     test_array();
     test_object();
+    test_object_map();
+    test_mutation();
+    test_stats();
+    test_key_pool();
+    test_json_pointer();
+    test_extract();
+    test_msgpack();
+    test_tape();
+    test_parse_allocs();
 
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
     return main_ret;